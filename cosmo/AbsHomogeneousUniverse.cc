@@ -7,3 +7,22 @@ namespace local = cosmo;
 local::AbsHomogeneousUniverse::AbsHomogeneousUniverse() { }
 
 local::AbsHomogeneousUniverse::~AbsHomogeneousUniverse() { }
+
+void local::AbsHomogeneousUniverse::getLineOfSightComovingDistances(int n, double const *z,
+double *result) const {
+    for(int i = 0; i < n; ++i) result[i] = getLineOfSightComovingDistance(z[i]);
+}
+
+void local::AbsHomogeneousUniverse::getDistances(int n, double const *z, double *lineOfSight,
+double *transverse, double *angularDiameter, double *luminosity, double *hubble) const {
+    for(int i = 0; i < n; ++i) {
+        lineOfSight[i] = getLineOfSightComovingDistance(z[i]);
+        if(transverse || angularDiameter || luminosity) {
+            double scale(getTransverseComovingScale(z[i]));
+            if(transverse) transverse[i] = scale;
+            if(angularDiameter) angularDiameter[i] = scale/(1+z[i]);
+            if(luminosity) luminosity[i] = scale*(1+z[i]);
+        }
+        if(hubble) hubble[i] = getHubbleFunction(z[i]);
+    }
+}
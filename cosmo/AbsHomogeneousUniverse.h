@@ -21,6 +21,19 @@ namespace cosmo {
         // emitters at the same specified redshift z >= 0. Multiply this value by
         // the observed separation angle (rad) to obtain a physical distance in Mpc/h.
         virtual double getTransverseComovingScale(double z) const = 0;
+        // Calculates the comoving line of sight distance in Mpc/h for each of n redshifts
+        // z[i] >= 0 and saves the results in result[i]. The default implementation calls
+        // getLineOfSightComovingDistance(z) for each redshift.
+        virtual void getLineOfSightComovingDistances(int n, double const *z, double *result) const;
+        // Calculates, for each of n redshifts z[i] >= 0, the comoving line of sight distance
+        // and the comoving transverse scale in Mpc/h, the angular diameter and luminosity
+        // distances, and the normalized Hubble function H(z)/H(0), saving them at index i
+        // of the corresponding arrays. Any of the output arrays after lineOfSight can be
+        // null to skip that quantity. The default implementation calls the corresponding
+        // method for each redshift.
+        virtual void getDistances(int n, double const *z, double *lineOfSight,
+            double *transverse = 0, double *angularDiameter = 0, double *luminosity = 0,
+            double *hubble = 0) const;
         // Returns the angular diameter distance of an emitter with the specified
         // redshift z >= 0.
         double getAngularDiameterDistance(double z) const;
@@ -3,20 +3,20 @@
 #include "cosmo/AdaptiveMultipoleTransform.h"
 #include "cosmo/RuntimeError.h"
 
-#include "likely/Interpolator.h"
-
-#include "boost/foreach.hpp"
-
 #include <cmath>
 #include <algorithm>
 
 namespace local = cosmo;
 
+local::AdaptiveMultipoleTransform::Workspace::Workspace() { }
+
+local::AdaptiveMultipoleTransform::Workspace::~Workspace() { }
+
 local::AdaptiveMultipoleTransform::AdaptiveMultipoleTransform(MultipoleTransform::Type type,
 int ell, double scale, std::vector<double>const &vpoints,
 double relerr, double abserr, double abspow)
 : _type(type), _ell(ell), _scale(scale), _vpoints(vpoints),
-_relerr(relerr), _abserr(abserr), _abspow(abspow), _veps(0)
+_relerr(relerr), _abserr(abserr), _abspow(abspow), _veps(0), _goodOffset(0), _workspace(new Workspace())
 {
 	// Input parameter validation
 	if(_type != MultipoleTransform::SphericalBessel && _type != MultipoleTransform::Hankel) {
@@ -49,31 +49,91 @@ _relerr(relerr), _abserr(abserr), _abspow(abspow), _veps(0)
 
 local::AdaptiveMultipoleTransform::~AdaptiveMultipoleTransform() { }
 
-void local::AdaptiveMultipoleTransform::_evaluate(likely::GenericFunctionPtr f,
-MultipoleTransformCPtr transform,std::vector<double> &result) const {
-	// Look up this transforms grids
-	std::vector<double> const &ugrid = transform->getUGrid(), &vgrid = transform->getVGrid();
-	// Prepare a grid of tabulated f(u) values
-	std::vector<double> fgrid;
-	fgrid.reserve(ugrid.size());
-	BOOST_FOREACH(double u, ugrid) {
-		fgrid.push_back((*f)(u));
-	}
-	// Calculate the corresponding grid of transform[f](v) values
-	std::vector<double> ftgrid;
-	(*transform).transform(fgrid,ftgrid);
-	// Interpolate transform[f](v) to _vpoints
-	likely::Interpolator interpolator(vgrid,ftgrid,"cspline");
+void local::AdaptiveMultipoleTransform::_createTransforms(double veps,
+MultipoleTransform::Strategy strategy, int minSamplesPerDecade) {
+	// The good transform is derived from the better one with half its sampling density,
+	// so we require twice the minimum samples per decade on the better grid to ensure
+	// that the good grid also meets the minimum. The better grid's v padding of 8 samples
+	// leaves at least (8-2)/2 = 3 good samples of padding at each end, since the good grid
+	// has twice the spacing and loses up to two better samples at each end.
+	int minSamplesPerCycle(2),interpolationPadding(8);
+	_mtBetter.reset(new MultipoleTransform(_type, _ell, _vmin, _vmax, veps,
+		strategy, minSamplesPerCycle, 2*minSamplesPerDecade, interpolationPadding));
+	_mtGood.reset(new MultipoleTransform(*_mtBetter,strategy));
+	_goodOffset = _mtBetter->getUGrid().size()/2 - _mtGood->getUGrid().size();
+	_initInterpolation(_mtBetter,_betterInterpolation);
+	_initInterpolation(_mtGood,_goodInterpolation);
+}
+
+void local::AdaptiveMultipoleTransform::_initInterpolation(MultipoleTransformCPtr transform,
+Interpolation &interpolation) const {
+	std::vector<double> const &vgrid = transform->getVGrid();
+	int nv(vgrid.size()), npoints(_vpoints.size());
+	if(nv < 4) {
+		throw RuntimeError("AdaptiveMultipoleTransform: too few v points to interpolate.");
+	}
+	interpolation.begin.resize(npoints);
+	interpolation.weights.resize(4*npoints);
+	for(int i = 0; i < npoints; ++i) {
+		// Use the 4 grid points centered on the interval containing this vpoint.
+		double v(_vpoints[i]);
+		int j = std::upper_bound(vgrid.begin(),vgrid.end(),v) - vgrid.begin() - 2;
+		if(j < 0) j = 0;
+		if(j > nv-4) j = nv-4;
+		interpolation.begin[i] = j;
+		for(int k = 0; k < 4; ++k) {
+			double weight(_scale);
+			for(int l = 0; l < 4; ++l) {
+				if(l != k) weight *= (v - vgrid[j+l])/(vgrid[j+k] - vgrid[j+l]);
+			}
+			interpolation.weights[4*i+k] = weight;
+		}
+	}
+}
+
+void local::AdaptiveMultipoleTransform::_interpolate(Interpolation const &interpolation,
+double const *ftgrid, std::vector<double> &result) const {
 	int npoints(_vpoints.size());
 	if(result.size() != npoints) std::vector<double>(npoints).swap(result);
+	// Each row has exactly 4 weights, so the inner loop is fixed length and vectorizes.
+	double const *weights = &interpolation.weights[0];
 	for(int i = 0; i < npoints; ++i) {
-		result[i] = _scale*interpolator(_vpoints[i]);
+		double const *ft = &ftgrid[interpolation.begin[i]];
+		double const *w = weights + 4*i;
+		result[i] = w[0]*ft[0] + w[1]*ft[1] + w[2]*ft[2] + w[3]*ft[3];
 	}
 }
 
-bool local::AdaptiveMultipoleTransform::_isTerminated(double margin) const {
+void local::AdaptiveMultipoleTransform::_evaluate(likely::GenericFunctionPtr f,
+Workspace &workspace, bool checked) const {
+	// Prepare a grid of tabulated f(u) values on the better u grid
+	std::vector<double> const &ugrid = _mtBetter->getUGrid();
+	std::vector<double> &fgrid = workspace._fgrid;
+	fgrid.resize(ugrid.size());
+	for(int i = 0; i < ugrid.size(); ++i) {
+		fgrid[i] = (*f)(ugrid[i]);
+	}
+	// Calculate the corresponding grid of transform[f](v) values and interpolate
+	// to _vpoints
+	std::vector<double> &ftgrid = workspace._ftgrid;
+	_mtBetter->transform(fgrid,ftgrid,workspace._mtWorkspace);
+	_interpolate(_betterInterpolation,&ftgrid[0],workspace._resultsBetter);
+	if(!checked) return;
+	// Repeat with the good transform, whose u grid is a subsample of the better grid.
+	std::vector<double> &fgridGood = workspace._fgridGood;
+	int nuGood(_mtGood->getUGrid().size());
+	fgridGood.resize(nuGood);
+	for(int i = 0; i < nuGood; ++i) {
+		fgridGood[i] = fgrid[2*i+_goodOffset];
+	}
+	_mtGood->transform(fgridGood,ftgrid,workspace._mtWorkspace);
+	_interpolate(_goodInterpolation,&ftgrid[0],workspace._resultsGood);
+}
+
+bool local::AdaptiveMultipoleTransform::_isTerminated(std::vector<double> const &resultsGood,
+std::vector<double> const &resultsBetter, double margin) const {
 	for(int i = 0; i < _vpoints.size(); ++i) {
-		double v(_vpoints[i]),f2e(_resultsGood[i]),fe(_resultsBetter[i]);
+		double v(_vpoints[i]),f2e(resultsGood[i]),fe(resultsBetter[i]);
 		double df = std::fabs(fe - f2e);
 		if(df > _abserr*std::pow(v,_abspow)/margin && df > _relerr*std::fabs(fe)/margin) {
 			return false;
@@ -82,15 +142,16 @@ bool local::AdaptiveMultipoleTransform::_isTerminated(double margin) const {
 	return true;
 }
 
-void local::AdaptiveMultipoleTransform::_saveResult(std::vector<double> &result) const {
+void local::AdaptiveMultipoleTransform::_saveResult(std::vector<double> &result,
+Workspace &workspace) const {
 	int npoints(_vpoints.size());
 	if(result.size() != npoints) {
 		// Replace results with a vector of the required size
 		std::vector<double>(npoints).swap(result);
 	}
-	// Swap the contents of result and our internal result vector. This just swaps
-	// pointers so is fast, and leaves our internal result vector with undefined contents.
-	_resultsBetter.swap(result);
+	// Swap the contents of result and the workspace result vector. This just swaps
+	// pointers so is fast, and leaves the workspace result vector with undefined contents.
+	workspace._resultsBetter.swap(result);
 }
 
 double local::AdaptiveMultipoleTransform::initialize(
@@ -100,7 +161,7 @@ int minSamplesPerDecade, double margin, double vepsMax, double vepsMin, bool opt
 		throw RuntimeError("AdaptiveMultipoleTransform: expected margin >= 1.");
 	}
 	MultipoleTransform::Strategy strategy(MultipoleTransform::EstimatePlan);
-	int minSamplesPerCycle(2),interpolationPadding(3);
+	Workspace &workspace(*_workspace);
 	// Create our first pair of transformers, if necessary
 	if(!_mtGood || !_mtBetter) {
 		if(vepsMax <= 0) {
@@ -115,34 +176,30 @@ int minSamplesPerDecade, double margin, double vepsMax, double vepsMin, bool opt
 			// Initialize without any min samples per decade, so we can see what it
 			// would be for this trial veps
 			int noMinSamplesPerDecade(0);
-			_mtBetter.reset(new MultipoleTransform(_type, _ell, _vmin, _vmax, _veps,
-				strategy, minSamplesPerCycle, noMinSamplesPerDecade, interpolationPadding));
-			// Is this veps small enough to meet our samples/decade requirement?
-			if(_mtBetter->getSamplesPerDecade() >= minSamplesPerDecade) break;
+			_createTransforms(_veps,strategy,noMinSamplesPerDecade);
+			// Is this veps small enough that the good grid, which has half the density of
+			// the better grid, meets our samples/decade requirement?
+			if(_mtGood->getSamplesPerDecade() >= minSamplesPerDecade) break;
 			// Otherwise, try a smaller veps
 			_veps /= 2;
 			if(_veps < vepsMin) {
 				throw RuntimeError("AdaptiveMultipoleTransform: reached vepsMin without convergence.");
 			}
 		}
-		// Calculate the corresponding prediction
-		_evaluate(f,_mtBetter,_resultsBetter);
-		// Initialize a "good" transformer with veps that is 2x larger
-		_mtGood.reset(new MultipoleTransform(_type, _ell, _vmin, _vmax, 2*_veps,
-			strategy, minSamplesPerCycle, minSamplesPerDecade, interpolationPadding));
-		_evaluate(f,_mtGood,_resultsGood);
+		// Rebuild with the minimum enforced, so that the grids we evaluate and test are
+		// the same ones that any later optimize step recreates.
+		_createTransforms(_veps,strategy,minSamplesPerDecade);
 	}
+	// Calculate the corresponding predictions
+	_evaluate(f,workspace,true);
 	while(true) {
 		// Check our termination criteria
-		if(_isTerminated(margin)) {
-			_saveResult(result);
+		if(_isTerminated(workspace._resultsGood,workspace._resultsBetter,margin)) {
+			_saveResult(result,workspace);
 			if(optimize) {
 				// Recreate transform objects using the MeasurePlan strategy
 				strategy = MultipoleTransform::MeasurePlan;
-				_mtGood.reset(new MultipoleTransform(_type, _ell, _vmin, _vmax, 2*_veps,
-					strategy, minSamplesPerCycle, minSamplesPerDecade, interpolationPadding));
-				_mtBetter.reset(new MultipoleTransform(_type, _ell, _vmin, _vmax, _veps,
-					strategy, minSamplesPerCycle, minSamplesPerDecade, interpolationPadding));
+				_createTransforms(_veps,strategy,minSamplesPerDecade);
 			}
 			return _veps;
 		}
@@ -151,26 +208,73 @@ int minSamplesPerDecade, double margin, double vepsMax, double vepsMin, bool opt
 		if(_veps < vepsMin) {
 			throw RuntimeError("AdaptiveMultipoleTransform: reached vepsMin without convergence.");
 		}
-		_mtGood = _mtBetter;
-		_resultsGood.swap(_resultsBetter);
-		_mtBetter.reset(new MultipoleTransform(_type, _ell, _vmin, _vmax, _veps,
-			strategy, minSamplesPerCycle, minSamplesPerDecade, interpolationPadding));
-		_evaluate(f,_mtBetter,_resultsBetter);
+		_createTransforms(_veps,strategy,minSamplesPerDecade);
+		_evaluate(f,workspace,true);
 	}
 }
 
 bool local::AdaptiveMultipoleTransform::transform(
 likely::GenericFunctionPtr f, std::vector<double> &result, bool bypassTerminationTest) const {
+	return transform(f,result,*_workspace,bypassTerminationTest);
+}
+
+bool local::AdaptiveMultipoleTransform::transform(likely::GenericFunctionPtr f,
+std::vector<double> &result, Workspace &workspace, bool bypassTerminationTest) const {
 	if(!_mtGood || !_mtBetter) {
 		throw RuntimeError("AdaptiveMultipoleTransform: must initialize before transforming.");
 	}
-	_evaluate(f,_mtBetter,_resultsBetter);
+	_evaluate(f,workspace,!bypassTerminationTest);
 	bool accurate(true);
 	if(!bypassTerminationTest) {
-		_evaluate(f,_mtGood,_resultsGood);
-		accurate = _isTerminated();
+		accurate = _isTerminated(workspace._resultsGood,workspace._resultsBetter);
+	}
+	_saveResult(result,workspace);
+	return accurate;
+}
+
+bool local::AdaptiveMultipoleTransform::transformBatch(
+std::vector<likely::GenericFunctionPtr> const &f, std::vector<std::vector<double> > &results,
+Workspace &workspace, bool bypassTerminationTest) const {
+	if(!_mtGood || !_mtBetter) {
+		throw RuntimeError("AdaptiveMultipoleTransform: must initialize before transforming.");
+	}
+	int nfunc(f.size());
+	if(results.size() != nfunc) results.resize(nfunc);
+	if(nfunc == 0) return true;
+	// Tabulate all functions on the better u grid.
+	std::vector<double> const &ugrid = _mtBetter->getUGrid();
+	int nu(ugrid.size());
+	std::vector<double> &fgrid = workspace._fgrid;
+	fgrid.resize((std::size_t)nfunc*nu);
+	for(int j = 0; j < nfunc; ++j) {
+		likely::GenericFunction const &fj(*f[j]);
+		double *row = &fgrid[(std::size_t)j*nu];
+		for(int i = 0; i < nu; ++i) row[i] = fj(ugrid[i]);
+	}
+	// Transform them together and interpolate each result to _vpoints.
+	std::vector<double> &ftgrid = workspace._ftgrid;
+	_mtBetter->transformBatch(fgrid,nfunc,ftgrid,workspace._mtWorkspace);
+	int nv(_mtBetter->getVGrid().size());
+	for(int j = 0; j < nfunc; ++j) {
+		_interpolate(_betterInterpolation,&ftgrid[(std::size_t)j*nv],results[j]);
+	}
+	if(bypassTerminationTest) return true;
+	// Repeat with the good transform, whose u grid is a subsample of the better grid.
+	std::vector<double> &fgridGood = workspace._fgridGood;
+	int nuGood(_mtGood->getUGrid().size());
+	fgridGood.resize((std::size_t)nfunc*nuGood);
+	for(int j = 0; j < nfunc; ++j) {
+		for(int i = 0; i < nuGood; ++i) {
+			fgridGood[(std::size_t)j*nuGood+i] = fgrid[(std::size_t)j*nu+2*i+_goodOffset];
+		}
+	}
+	_mtGood->transformBatch(fgridGood,nfunc,ftgrid,workspace._mtWorkspace);
+	int nvGood(_mtGood->getVGrid().size());
+	bool accurate(true);
+	for(int j = 0; j < nfunc; ++j) {
+		_interpolate(_goodInterpolation,&ftgrid[(std::size_t)j*nvGood],workspace._resultsGood);
+		accurate &= _isTerminated(workspace._resultsGood,results[j]);
 	}
-	_saveResult(result);
 	return accurate;
 }
 
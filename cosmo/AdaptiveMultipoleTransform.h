@@ -16,8 +16,23 @@ namespace cosmo {
 	// Uses the MultipoleTransform class to calculate transforms but replaces the
 	// veps numerical control parameter with accuracy criteria that are used to
 	// automatically set veps. Also takes a function pointer as input, instead of
-	// requiring the user to tabulate function values.
+	// requiring the user to tabulate function values. The "good" transform used to
+	// monitor numerical errors has half the sampling density of the "better" transform
+	// whose results are returned, and its u grid is a subsample of the better u grid,
+	// so each function only needs to be tabulated once. Results are interpolated to
+	// the requested vpoints using precomputed 4-point Lagrange weights.
 	public:
+		// Holds the scratch memory used by transform(). A workspace can be used with any
+		// adaptive transform object, but must not be used by more than one thread at a time.
+		class Workspace {
+		public:
+			Workspace();
+			virtual ~Workspace();
+		private:
+			friend class AdaptiveMultipoleTransform;
+			MultipoleTransform::Workspace _mtWorkspace;
+			std::vector<double> _fgrid, _fgridGood, _ftgrid, _resultsGood, _resultsBetter;
+		}; // AdaptiveMultipoleTransform::Workspace
 		// Creates a new transformer of the specified type and multipole. Subsequent
 		// transforms will be provided at the specified vpoints, which will also be
 		// used to adaptively monitor numerical errors. The numerical termination
@@ -40,7 +55,9 @@ namespace cosmo {
 		// optimization step takes at least a few seconds so is only worth doing if
 		// many transforms will be performed per initialization. Note that optimized
 		// transforms will generally give different numerical results at the level of
-		// roundoff errors. Returns the selected veps value.
+		// roundoff errors. Both the good and better transforms have at least
+		// minSamplesPerDecade u samples per decade, so the better transform whose results
+		// are returned has at least twice this. Returns the selected veps value.
 		double initialize(likely::GenericFunctionPtr f, std::vector<double> &result,
 			int minSamplesPerDecade= 40, double margin = 2,
 			double vepsMax = 0.01, double vepsMin = 1e-6, bool optimize = false);
@@ -48,9 +65,25 @@ namespace cosmo {
 		// from the most recent call to initialize(). Results are stored in the vector
 		// provided, which will be resized if necessary. Returns true if the termination
 		// criteria are met, unless bypassTerminationTest is true (in which case we
-		// always return true and transforms will be somewhat faster).
+		// always return true and transforms will be somewhat faster). This method uses
+		// an internal workspace so is not thread safe.
 		bool transform(likely::GenericFunctionPtr f, std::vector<double> &result,
 			bool bypassTerminationTest = false) const;
+		// Same as above but all scratch memory is taken from the workspace provided, so
+		// that different threads can safely share one initialized transform object as
+		// long as each thread uses its own workspace (and f is safe to call concurrently).
+		bool transform(likely::GenericFunctionPtr f, std::vector<double> &result,
+			Workspace &workspace, bool bypassTerminationTest = false) const;
+		// Calculates the transforms of several functions together, using the veps determined
+		// from the most recent call to initialize(). Each function is tabulated on our u
+		// grids and all of them are transformed with batched FFTs. Results are stored in
+		// the vectors provided, one per function, which will be resized if necessary.
+		// Returns true if the termination criteria are met for every function, unless
+		// bypassTerminationTest is true. Scratch memory is taken from the workspace
+		// provided, as for transform().
+		bool transformBatch(std::vector<likely::GenericFunctionPtr> const &f,
+			std::vector<std::vector<double> > &results, Workspace &workspace,
+			bool bypassTerminationTest = false) const;
 		// Returns our relative error target.
 		double getRelErr() const;
 		// Returns our absolute error target.
@@ -69,17 +102,31 @@ namespace cosmo {
 		// Returns the number of u samples per decade n/log10(umax/umin).
 		double getUSamplesPerDecade() const;
 	private:
+		// Sparse weights for interpolating a transform's v grid to our vpoints, so that
+		// result[i] = sum(weights[4*i+k]*ftgrid[begin[i]+k],k=0..3), including our scale.
+		struct Interpolation {
+			std::vector<int> begin;
+			std::vector<double> weights;
+		};
 		MultipoleTransform::Type _type;
 		int _ell;
 		std::vector<double> _vpoints;
-		mutable std::vector<double> _resultsGood, _resultsBetter;
 		double _scale, _relerr, _abserr, _abspow, _vmin, _vmax, _veps;
 		typedef boost::shared_ptr<const MultipoleTransform> MultipoleTransformCPtr;
 		MultipoleTransformCPtr _mtGood, _mtBetter;
-		void _evaluate(likely::GenericFunctionPtr f,
-			MultipoleTransformCPtr transform, std::vector<double> &result) const;
-		bool _isTerminated(double margin = 1) const;
-		void _saveResult(std::vector<double> &result) const;
+		// Offset of the good u grid within the better u grid.
+		int _goodOffset;
+		Interpolation _goodInterpolation, _betterInterpolation;
+		boost::scoped_ptr<Workspace> _workspace;
+		void _createTransforms(double veps, MultipoleTransform::Strategy strategy,
+			int minSamplesPerDecade);
+		void _initInterpolation(MultipoleTransformCPtr transform, Interpolation &interpolation) const;
+		void _interpolate(Interpolation const &interpolation, double const *ftgrid,
+			std::vector<double> &result) const;
+		void _evaluate(likely::GenericFunctionPtr f, Workspace &workspace, bool checked) const;
+		bool _isTerminated(std::vector<double> const &resultsGood,
+			std::vector<double> const &resultsBetter, double margin = 1) const;
+		void _saveResult(std::vector<double> &result, Workspace &workspace) const;
 	}; // AdaptiveMultipoleTransform
 
 	inline double AdaptiveMultipoleTransform::getRelErr() const { return _relerr; }
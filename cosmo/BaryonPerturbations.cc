@@ -3,6 +3,9 @@
 #include "cosmo/BaryonPerturbations.h"
 #include "cosmo/RuntimeError.h"
 #include "cosmo/AbsHomogeneousUniverse.h"
+#include "cosmo/CubicSpline.h"
+
+#include "boost/bind.hpp"
 
 #include <cmath>
 
@@ -89,42 +92,34 @@ double local::BaryonPerturbations::getNode(int n) const {
 }
 
 double local::BaryonPerturbations::getCdmTransfer(double kMpch) const {
-    if(kMpch != _kSave) {
-        calculateTransferFunctions(kMpch,_Tf_baryon,_Tf_cdm,_Tf_full,_Tf_nw,_baoOption);
-        _kSave = kMpch;
-    }
-    return _Tf_cdm;
+    double Tf_baryon,Tf_cdm,Tf_full,Tf_nw;
+    calculateTransferFunctions(kMpch,Tf_baryon,Tf_cdm,Tf_full,Tf_nw,_baoOption);
+    return Tf_cdm;
 }
 
 double local::BaryonPerturbations::getBaryonTransfer(double kMpch) const {
-    if(kMpch != _kSave) {
-        calculateTransferFunctions(kMpch,_Tf_baryon,_Tf_cdm,_Tf_full,_Tf_nw,_baoOption);
-        _kSave = kMpch;
-    }
-    return _Tf_baryon;
+    double Tf_baryon,Tf_cdm,Tf_full,Tf_nw;
+    calculateTransferFunctions(kMpch,Tf_baryon,Tf_cdm,Tf_full,Tf_nw,_baoOption);
+    return Tf_baryon;
 }
 
 double local::BaryonPerturbations::getMatterTransfer(double kMpch) const {
-    if(kMpch != _kSave) {
-        calculateTransferFunctions(kMpch,_Tf_baryon,_Tf_cdm,_Tf_full,_Tf_nw,_baoOption);
-        _kSave = kMpch;
-    }
-    return _Tf_full;
+    double Tf_baryon,Tf_cdm,Tf_full,Tf_nw;
+    calculateTransferFunctions(kMpch,Tf_baryon,Tf_cdm,Tf_full,Tf_nw,_baoOption);
+    return Tf_full;
 }
 
 double local::BaryonPerturbations::getNoWigglesTransfer(double kMpch) const {
-    if(kMpch != _kSave) {
-        calculateTransferFunctions(kMpch,_Tf_baryon,_Tf_cdm,_Tf_full,_Tf_nw,_baoOption);
-        _kSave = kMpch;
-    }
-    return _Tf_nw;
+    double Tf_baryon,Tf_cdm,Tf_full,Tf_nw;
+    calculateTransferFunctions(kMpch,Tf_baryon,Tf_cdm,Tf_full,Tf_nw,_baoOption);
+    return Tf_nw;
 }
 
 void local::BaryonPerturbations::calculateTransferFunctions(double kMpch,
 double &Tf_baryon, double &Tf_cdm, double &Tf_full, double &Tf_nw, BaoOption baoOption) const {
 
     if(0 == kMpch) {
-        Tf_baryon = Tf_cdm = Tf_full = 1;
+        Tf_baryon = Tf_cdm = Tf_full = Tf_nw = 1;
         return;
     }
 
@@ -188,3 +183,166 @@ double &Tf_baryon, double &Tf_cdm, double &Tf_full, double &Tf_nw, BaoOption bao
     double C0 = 14.2 + 731.0/(1+62.5*q_eff);
     Tf_nw = L0/(L0 + C0*q_eff*q_eff);
 }
+
+void local::BaryonPerturbations::calculateTransferFunctions(std::vector<double> const &kMpch,
+std::vector<double> &Tf_baryon, std::vector<double> &Tf_cdm, std::vector<double> &Tf_full,
+std::vector<double> &Tf_nw, BaoOption baoOption) const {
+
+    int n(kMpch.size());
+    Tf_baryon.resize(n);
+    Tf_cdm.resize(n);
+    Tf_full.resize(n);
+    Tf_nw.resize(n);
+    if(0 == n) return;
+
+    // Work with raw pointers and local copies of our parameters so that the loops below
+    // have no aliasing or member accesses. The arithmetic is identical to the
+    // single-wavenumber version above. The loops are marked as SIMD loops, but they only
+    // vectorize when the compiler has vector versions of log, exp, pow and sin, which
+    // requires configure --enable-vector-math with gcc and glibc.
+    double const *kptr(&kMpch[0]);
+    double *Tb(&Tf_baryon[0]), *Tc(&Tf_cdm[0]), *Tf(&Tf_full[0]), *Tnw(&Tf_nw[0]);
+    double h(_hubbleConstant), s(_sound_horizon), kEq(_k_equality), kSilk(_k_silk);
+    double alpha_c(_alpha_c), beta_c(_beta_c), alpha_b(_alpha_b), beta_b(_beta_b);
+    double beta_node(_beta_node), omhh(_omhh), alpha_gamma(_alpha_gamma);
+    double s_fit(_sound_horizon_fit), f_baryon(_obhh/_omhh);
+
+    // Calculate the CDM, baryon envelope and no-wiggles transfer functions.
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for(int i = 0; i < n; ++i) {
+        double k(kptr[i]*h);
+        double q(k/13.41/kEq);
+        double qSq(q*q);
+        double xx(k*s);
+
+        double T_c_ln_beta(std::log(2.718282+1.8*beta_c*q));
+        double T_c_ln_nobeta(std::log(2.718282+1.8*q));
+        double T_c_C_base(386.0/(1+69.9*std::pow(q,1.08)));
+        double T_c_C_alpha(14.2/alpha_c + T_c_C_base);
+        double T_c_C_noalpha(14.2 + T_c_C_base);
+
+        double tmp(xx/5.4),tmp2(tmp*tmp);
+        double T_c_f(1.0/(1.0+tmp2*tmp2));
+        Tc[i] = T_c_f*T_c_ln_beta/(T_c_ln_beta+T_c_C_noalpha*qSq) +
+            (1-T_c_f)*T_c_ln_beta/(T_c_ln_beta+T_c_C_alpha*qSq);
+
+        double T_b_T0(T_c_ln_nobeta/(T_c_ln_nobeta+T_c_C_noalpha*qSq));
+        tmp = xx/5.2;
+        double Tbi(T_b_T0/(1+tmp*tmp));
+        tmp = beta_b/xx;
+        tmp2 = tmp*tmp;
+        Tb[i] = Tbi + alpha_b/(1+tmp*tmp2)*std::exp(-std::pow(k/kSilk,1.4));
+
+        tmp = 0.43*k*s_fit;
+        tmp2 = tmp*tmp;
+        double gamma_eff = omhh*(alpha_gamma + (1-alpha_gamma)/(1+tmp2*tmp2));
+        double q_eff(q*omhh/gamma_eff);
+        double L0 = std::log(2.0*2.718282+1.8*q_eff);
+        double C0 = 14.2 + 731.0/(1+62.5*q_eff);
+        Tnw[i] = L0/(L0 + C0*q_eff*q_eff);
+    }
+
+    // Apply the baryon acoustic oscillations, with the option tested once outside each loop.
+    if(baoOption == PeriodicOscillation) {
+#ifdef _OPENMP
+        #pragma omp simd
+#endif
+        for(int i = 0; i < n; ++i) {
+            double xx(kptr[i]*h*s);
+            Tb[i] *= std::sin(xx)/xx;
+        }
+    }
+    else if(baoOption == NoOscillation) {
+#ifdef _OPENMP
+        #pragma omp simd
+#endif
+        for(int i = 0; i < n; ++i) {
+            double k(kptr[i]*h);
+            double tmp(beta_node/(k*s));
+            double xx_tilde(k*s*std::pow(1+tmp*tmp*tmp,-1./3.));
+            double tmp2(xx_tilde*xx_tilde);
+            Tb[i] *= std::pow(1+tmp2*tmp2,-0.25);
+        }
+    }
+    else {
+#ifdef _OPENMP
+        #pragma omp simd
+#endif
+        for(int i = 0; i < n; ++i) {
+            double k(kptr[i]*h);
+            double tmp(beta_node/(k*s));
+            double xx_tilde(k*s*std::pow(1+tmp*tmp*tmp,-1./3.));
+            Tb[i] *= std::sin(xx_tilde)/xx_tilde;
+        }
+    }
+
+    // Combine the baryon and CDM transfer functions.
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for(int i = 0; i < n; ++i) {
+        Tf[i] = f_baryon*Tb[i] + (1-f_baryon)*Tc[i];
+    }
+
+    // All transfer functions are exactly one at k = 0, where the expressions above are singular.
+#ifdef _OPENMP
+    #pragma omp simd
+#endif
+    for(int i = 0; i < n; ++i) {
+        if(0 == kptr[i]) Tb[i] = Tc[i] = Tf[i] = Tnw[i] = 1;
+    }
+}
+
+namespace cosmo {
+    namespace baryon_perturbations {
+        // Interpolates a transfer function tabulated on a uniform grid in log(k).
+        class TransferTable {
+        public:
+            TransferTable(boost::shared_ptr<const BaryonPerturbations> baryons, bool noWiggles,
+            double kmin, double kmax, int pointsPerDecade)
+            : _baryons(baryons), _noWiggles(noWiggles), _kmin(kmin), _kmax(kmax)
+            {
+                int nk = 1 + (int)std::ceil(pointsPerDecade*std::log10(kmax/kmin));
+                std::vector<double> logk(nk), k(nk), Tf_baryon, Tf_cdm, Tf_full, Tf_nw;
+                double dlogk((std::log(kmax) - std::log(kmin))/(nk-1));
+                for(int i = 0; i < nk; ++i) {
+                    logk[i] = std::log(kmin) + i*dlogk;
+                    k[i] = std::exp(logk[i]);
+                }
+                _baryons->calculateTransferFunctions(k,Tf_baryon,Tf_cdm,Tf_full,Tf_nw,
+                    _baryons->getBaoOption());
+                _spline.reset(new CubicSpline(logk));
+                _spline->fit(noWiggles ? Tf_nw : Tf_full);
+            }
+            double evaluate(double kMpch) const {
+                if(kMpch < _kmin || kMpch > _kmax) {
+                    return _noWiggles ?
+                        _baryons->getNoWigglesTransfer(kMpch) : _baryons->getMatterTransfer(kMpch);
+                }
+                return (*_spline)(std::log(kMpch));
+            }
+        private:
+            boost::shared_ptr<const BaryonPerturbations> _baryons;
+            bool _noWiggles;
+            double _kmin, _kmax;
+            boost::scoped_ptr<CubicSpline> _spline;
+        }; // TransferTable
+    } // baryon_perturbations
+} // cosmo
+
+local::TransferFunctionPtr local::createTabulatedTransferFunction(
+boost::shared_ptr<const BaryonPerturbations> baryons, bool noWiggles,
+double kmin, double kmax, int pointsPerDecade) {
+    if(!(kmin > 0) || !(kmax > kmin)) {
+        throw RuntimeError("createTabulatedTransferFunction: expected 0 < kmin < kmax.");
+    }
+    if(pointsPerDecade <= 0) {
+        throw RuntimeError("createTabulatedTransferFunction: expected pointsPerDecade > 0.");
+    }
+    boost::shared_ptr<baryon_perturbations::TransferTable> table(
+        new baryon_perturbations::TransferTable(baryons,noWiggles,kmin,kmax,pointsPerDecade));
+    return TransferFunctionPtr(new TransferFunction(boost::bind(
+        &baryon_perturbations::TransferTable::evaluate,table,_1)));
+}
@@ -3,6 +3,12 @@
 #ifndef COSMO_BARYON_PERTURBATIONS
 #define COSMO_BARYON_PERTURBATIONS
 
+#include "cosmo/types.h"
+
+#include "boost/smart_ptr.hpp"
+
+#include <vector>
+
 namespace cosmo {
     // Calculates baryon perturbations to a homogenous universe using the results in
     // Eisenstein & Hu, "Baryonic Features in the Matter Transfer Function", astro-ph/9709112
@@ -19,6 +25,8 @@ namespace cosmo {
 		BaryonPerturbations(double omegaMatter, double omegaBaryon,
 		    double hubbleConstant, double cmbTemperature, BaoOption baoOption = ShiftedOscillation);
 		virtual ~BaryonPerturbations();
+        // Returns the BAO option used by the get...Transfer methods.
+        BaoOption getBaoOption() const;
 		// Returns the redshift of matter-radiation equality. See eqn. (2).
         double getMatterRadiationEqualityRedshift() const;
         // Returns the wavenumber of the particle horizon at matter-radiation equality in
@@ -50,6 +58,14 @@ namespace cosmo {
         void calculateTransferFunctions(double kMpch,
             double &Tf_baryon, double &Tf_cdm, double &Tf_full, double &Tf_nw,
             BaoOption baoOption = ShiftedOscillation) const;
+        // Calculates the same transfer functions for each element of an array of input
+        // wavenumbers in 1/(Mpc/h). The output vectors are resized to match the input.
+        // Each step of the calculation is applied to all wavenumbers in a single loop,
+        // which uses SIMD vector math when configured with --enable-vector-math.
+        void calculateTransferFunctions(std::vector<double> const &kMpch,
+            std::vector<double> &Tf_baryon, std::vector<double> &Tf_cdm,
+            std::vector<double> &Tf_full, std::vector<double> &Tf_nw,
+            BaoOption baoOption = ShiftedOscillation) const;
         // Returns the value of k*s/pi for the n-th node of the BAO oscillation (n=1,2,3,...)
         // where s is the sound horizon. Values approach n for large n but are generally
         // larger for the first few nodes. See eqn. (22).
@@ -76,9 +92,11 @@ namespace cosmo {
         	_k_peak,		/* Fit to wavenumber of first peak, in Mpc^-1 */
         	_sound_horizon_fit,	/* Fit to sound horizon, in Mpc */
         	_alpha_gamma;	/* Gamma suppression in approximate TF */
-        mutable double _Tf_baryon, _Tf_cdm, _Tf_full, _Tf_nw, _kSave;
 	}; // BaryonPerturbations
 	
+	inline BaryonPerturbations::BaoOption BaryonPerturbations::getBaoOption() const {
+        return _baoOption;
+	}
 	inline double BaryonPerturbations::getMatterRadiationEqualityRedshift() const {
         return _z_equality - 1;
 	}
@@ -97,6 +115,18 @@ namespace cosmo {
 	inline double BaryonPerturbations::getSilkDampingScale() const {
         return _k_silk/_hubbleConstant;
 	}
+
+    // Returns a transfer function that interpolates the matter transfer function of the
+    // specified perturbations, or its no-wiggles version, on a table of wavenumbers that
+    // are logarithmically spaced between kmin and kmax in 1/(Mpc/h). The table is filled
+    // with a single call to the array version of calculateTransferFunctions, so the
+    // result is much cheaper to evaluate many times, e.g. to normalize or tabulate a
+    // power spectrum. The interpolation relative error is at most about 1e-6 with the
+    // default spacing. Wavenumbers outside the table are calculated directly. The returned
+    // function keeps the perturbations alive.
+    TransferFunctionPtr createTabulatedTransferFunction(
+        boost::shared_ptr<const BaryonPerturbations> baryons, bool noWiggles = false,
+        double kmin = 1e-4, double kmax = 1e2, int pointsPerDecade = 1000);
 	
 } // cosmo
 
@@ -0,0 +1,149 @@
+// Created 16-Oct-2026 by agent <agent@local>
+
+#include "cosmo/BinaryCatalogReader.h"
+#include "cosmo/RuntimeError.h"
+
+#include "likely/Interpolator.h"
+
+#include "boost/cstdint.hpp"
+
+#include <fstream>
+#include <cstring>
+#include <limits>
+
+namespace local = cosmo;
+
+local::BinaryCatalogReader::BinaryCatalogReader(std::string const &filename)
+: _file(filename)
+{
+	char const *data(_file.getData());
+	std::size_t size(_file.getSize());
+	if(size < binary_catalog::headerSize ||
+	0 != std::memcmp(data,binary_catalog::magic,sizeof(binary_catalog::magic))) {
+		throw RuntimeError("BinaryCatalogReader: " + filename + " is not a binary catalog.");
+	}
+	boost::uint32_t version,ncolumns;
+	boost::uint64_t nrows;
+	std::memcpy(&version,data+8,4);
+	std::memcpy(&ncolumns,data+12,4);
+	std::memcpy(&nrows,data+16,8);
+	// A version written with the other byte order will not match here.
+	if(version != binary_catalog::version) {
+		throw RuntimeError("BinaryCatalogReader: unsupported version or byte order in " + filename + ".");
+	}
+	// Check the header sizes without any arithmetic that could overflow.
+	if(ncolumns > (boost::uint32_t)std::numeric_limits<int>::max() ||
+	ncolumns > (size - binary_catalog::headerSize)/binary_catalog::descriptorSize) {
+		throw RuntimeError("BinaryCatalogReader: truncated header in " + filename + ".");
+	}
+	if(nrows > (boost::uint64_t)std::numeric_limits<long>::max()) {
+		throw RuntimeError("BinaryCatalogReader: invalid number of rows in " + filename + ".");
+	}
+	_ncolumns = (int)ncolumns;
+	_nrows = (long)nrows;
+	for(int column = 0; column < _ncolumns; ++column) {
+		char const *descriptor = data + binary_catalog::headerSize +
+			(std::size_t)column*binary_catalog::descriptorSize;
+		char name[binary_catalog::nameSize+1];
+		std::memcpy(name,descriptor,binary_catalog::nameSize);
+		name[binary_catalog::nameSize] = 0;
+		boost::uint32_t type;
+		boost::uint64_t offset;
+		std::memcpy(&type,descriptor+binary_catalog::nameSize,4);
+		std::memcpy(&offset,descriptor+binary_catalog::nameSize+8,8);
+		std::size_t valueSize;
+		if(type == Float64Column) valueSize = sizeof(double);
+		else if(type == Float32Column) valueSize = sizeof(float);
+		else throw RuntimeError("BinaryCatalogReader: invalid column type in " + filename + ".");
+		// Column data must be aligned so that it can be accessed in place.
+		if(offset % binary_catalog::alignment != 0) {
+			throw RuntimeError("BinaryCatalogReader: misaligned column data in " + filename + ".");
+		}
+		if(offset > size || nrows > (size - offset)/valueSize) {
+			throw RuntimeError("BinaryCatalogReader: truncated column data in " + filename + ".");
+		}
+		_names.push_back(std::string(name));
+		_types.push_back((CatalogColumnType)type);
+		_columns.push_back(data + offset);
+	}
+}
+
+local::BinaryCatalogReader::~BinaryCatalogReader() { }
+
+bool local::BinaryCatalogReader::isBinaryCatalog(std::string const &filename) {
+	std::ifstream in(filename.c_str(),std::ios::in | std::ios::binary);
+	char magic[sizeof(binary_catalog::magic)];
+	if(!in.read(magic,sizeof(magic))) return false;
+	return 0 == std::memcmp(magic,binary_catalog::magic,sizeof(magic));
+}
+
+void local::BinaryCatalogReader::_checkColumn(int column, char const *method) const {
+	if(column < 0 || column >= _ncolumns) {
+		throw RuntimeError(std::string("BinaryCatalogReader::") + method + ": invalid column index.");
+	}
+}
+
+std::string const &local::BinaryCatalogReader::getColumnName(int column) const {
+	_checkColumn(column,"getColumnName");
+	return _names[column];
+}
+
+local::CatalogColumnType local::BinaryCatalogReader::getColumnType(int column) const {
+	_checkColumn(column,"getColumnType");
+	return _types[column];
+}
+
+int local::BinaryCatalogReader::getColumnIndex(std::string const &name) const {
+	for(int column = 0; column < _ncolumns; ++column) {
+		if(_names[column] == name) return column;
+	}
+	throw RuntimeError("BinaryCatalogReader::getColumnIndex: no such column \"" + name + "\".");
+}
+
+double const *local::BinaryCatalogReader::getFloat64Column(int column) const {
+	_checkColumn(column,"getFloat64Column");
+	if(_types[column] != Float64Column) {
+		throw RuntimeError("BinaryCatalogReader::getFloat64Column: column type is not Float64Column.");
+	}
+	return reinterpret_cast<double const*>(_columns[column]);
+}
+
+float const *local::BinaryCatalogReader::getFloat32Column(int column) const {
+	_checkColumn(column,"getFloat32Column");
+	if(_types[column] != Float32Column) {
+		throw RuntimeError("BinaryCatalogReader::getFloat32Column: column type is not Float32Column.");
+	}
+	return reinterpret_cast<float const*>(_columns[column]);
+}
+
+void local::BinaryCatalogReader::getColumn(int column, std::vector<double> &values) const {
+	_checkColumn(column,"getColumn");
+	if(_types[column] == Float64Column) {
+		double const *begin = reinterpret_cast<double const*>(_columns[column]);
+		values.assign(begin,begin+_nrows);
+	}
+	else {
+		float const *begin = reinterpret_cast<float const*>(_columns[column]);
+		values.assign(begin,begin+_nrows);
+	}
+}
+
+void local::readCatalog(std::string const &filename, std::vector<std::vector<double> > &columns) {
+	if(BinaryCatalogReader::isBinaryCatalog(filename)) {
+		BinaryCatalogReader reader(filename);
+		if(reader.getNumColumns() < columns.size()) {
+			throw RuntimeError("readCatalog: " + filename + " has too few columns.");
+		}
+		for(int column = 0; column < columns.size(); ++column) {
+			reader.getColumn(column,columns[column]);
+		}
+	}
+	else {
+		std::ifstream in(filename.c_str());
+		if(!in) {
+			throw RuntimeError("readCatalog: unable to open " + filename + ".");
+		}
+		likely::readVectors(in,columns);
+		in.close();
+	}
+}
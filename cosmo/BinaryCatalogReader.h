@@ -0,0 +1,77 @@
+// Created 16-Oct-2026 by agent <agent@local>
+
+#ifndef COSMO_BINARY_CATALOG_READER
+#define COSMO_BINARY_CATALOG_READER
+
+#include "cosmo/types.h"
+#include "cosmo/MemoryMappedFile.h"
+
+#include <string>
+#include <vector>
+
+namespace cosmo {
+	class BinaryCatalogReader {
+	// Provides zero-copy access to the columns of a binary catalog file, which is mapped
+	// into memory. A binary catalog consists of a header followed by the values of each
+	// column stored contiguously, in native byte order. The header is:
+	//
+	//   char magic[8] = "COSMOCAT", uint32 version, uint32 ncolumns, uint64 nrows
+	//
+	// followed by one 64-byte descriptor per column:
+	//
+	//   char name[48] (null padded), uint32 type, uint32 unused, uint64 offset
+	//
+	// where offset is the position of the column's first value relative to the start of
+	// the file. Column data is aligned to 64 bytes. See BinaryCatalogWriter for creating
+	// these files.
+	public:
+		// Opens the named binary catalog file, or throws a RuntimeError if it is not valid.
+		explicit BinaryCatalogReader(std::string const &filename);
+		virtual ~BinaryCatalogReader();
+		// Returns true if the named file exists and starts with a binary catalog header.
+		static bool isBinaryCatalog(std::string const &filename);
+		// Returns the number of columns and rows in this catalog.
+		int getNumColumns() const;
+		long getNumRows() const;
+		// Returns the name and type of the specified column.
+		std::string const &getColumnName(int column) const;
+		CatalogColumnType getColumnType(int column) const;
+		// Returns the index of the named column or throws a RuntimeError.
+		int getColumnIndex(std::string const &name) const;
+		// Returns a pointer to the values of the specified column, which remain valid for
+		// the lifetime of this object. Throws a RuntimeError if the column does not have
+		// the requested type.
+		double const *getFloat64Column(int column) const;
+		float const *getFloat32Column(int column) const;
+		// Copies the values of the specified column into the vector provided, converting
+		// them to double precision if necessary.
+		void getColumn(int column, std::vector<double> &values) const;
+	private:
+		void _checkColumn(int column, char const *method) const;
+		MemoryMappedFile _file;
+		int _ncolumns;
+		long _nrows;
+		std::vector<std::string> _names;
+		std::vector<CatalogColumnType> _types;
+		std::vector<char const*> _columns;
+	}; // BinaryCatalogReader
+
+	inline int BinaryCatalogReader::getNumColumns() const { return _ncolumns; }
+	inline long BinaryCatalogReader::getNumRows() const { return _nrows; }
+
+	namespace binary_catalog {
+		// Layout constants for the binary catalog format described above.
+		char const magic[8] = { 'C','O','S','M','O','C','A','T' };
+		const int version = 1;
+		const int headerSize = 24, descriptorSize = 64, nameSize = 48, alignment = 64;
+	}
+
+	// Reads catalog columns from the named file, which can either be a binary catalog or
+	// a text file of whitespace-separated values with one row per line. The size of the
+	// columns vector determines how many of the leading columns are read. A binary catalog
+	// must have at least this many columns.
+	void readCatalog(std::string const &filename, std::vector<std::vector<double> > &columns);
+
+} // cosmo
+
+#endif // COSMO_BINARY_CATALOG_READER
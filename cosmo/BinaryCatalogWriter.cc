@@ -0,0 +1,161 @@
+// Created 16-Oct-2026 by agent <agent@local>
+
+#include "cosmo/BinaryCatalogWriter.h"
+#include "cosmo/BinaryCatalogReader.h"
+#include "cosmo/RuntimeError.h"
+
+#include "boost/cstdint.hpp"
+
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace local = cosmo;
+
+local::BinaryCatalogWriter::BinaryCatalogWriter(std::string const &filename,
+std::vector<std::string> const &names, long nrows, CatalogColumnType type)
+: _filename(filename), _names(names), _type(type), _fd(-1), _data(0)
+{
+	_ncolumns = _names.size();
+	if(0 == _ncolumns) {
+		throw RuntimeError("BinaryCatalogWriter: expected at least one column.");
+	}
+	for(int column = 0; column < _ncolumns; ++column) {
+		if(0 == _names[column].length() || _names[column].length() >= binary_catalog::nameSize) {
+			throw RuntimeError("BinaryCatalogWriter: invalid column name \"" + _names[column] + "\".");
+		}
+	}
+	if(nrows < 0) {
+		throw RuntimeError("BinaryCatalogWriter: expected nrows >= 0.");
+	}
+	if(_type == Float64Column) _valueSize = sizeof(double);
+	else if(_type == Float32Column) _valueSize = sizeof(float);
+	else throw RuntimeError("BinaryCatalogWriter: invalid column type.");
+	_layout(nrows);
+	_mappedSize = _fileSize;
+	_fd = ::open(_filename.c_str(),O_RDWR | O_CREAT | O_TRUNC,0644);
+	if(_fd < 0) {
+		throw RuntimeError("BinaryCatalogWriter: unable to create " + _filename + ".");
+	}
+	if(::ftruncate(_fd,_mappedSize) != 0) {
+		::close(_fd);
+		throw RuntimeError("BinaryCatalogWriter: unable to allocate " + _filename + ".");
+	}
+	void *addr = ::mmap(0,_mappedSize,PROT_READ | PROT_WRITE,MAP_SHARED,_fd,0);
+	if(addr == MAP_FAILED) {
+		::close(_fd);
+		throw RuntimeError("BinaryCatalogWriter: unable to map " + _filename + ".");
+	}
+	_data = static_cast<char*>(addr);
+	_writeHeader();
+}
+
+local::BinaryCatalogWriter::~BinaryCatalogWriter() {
+	// Destructors must not throw, so any errors here are ignored.
+	try {
+		close();
+	}
+	catch(RuntimeError const &e) { }
+}
+
+void local::BinaryCatalogWriter::_layout(long nrows) {
+	// Calculate the offset of each column, with each one aligned in the file.
+	_nrows = nrows;
+	_offsets.resize(_ncolumns);
+	std::size_t offset(binary_catalog::headerSize + _ncolumns*binary_catalog::descriptorSize);
+	for(int column = 0; column < _ncolumns; ++column) {
+		offset = binary_catalog::alignment*((offset + binary_catalog::alignment - 1)/binary_catalog::alignment);
+		_offsets[column] = offset;
+		offset += _nrows*_valueSize;
+	}
+	_fileSize = offset;
+}
+
+void local::BinaryCatalogWriter::_writeHeader() {
+	boost::uint32_t version(binary_catalog::version), ncolumns(_ncolumns), type(_type), unused(0);
+	boost::uint64_t nrows(_nrows);
+	std::memcpy(_data,binary_catalog::magic,sizeof(binary_catalog::magic));
+	std::memcpy(_data+8,&version,4);
+	std::memcpy(_data+12,&ncolumns,4);
+	std::memcpy(_data+16,&nrows,8);
+	for(int column = 0; column < _ncolumns; ++column) {
+		char *descriptor = _data + binary_catalog::headerSize + column*binary_catalog::descriptorSize;
+		boost::uint64_t offset(_offsets[column]);
+		std::memset(descriptor,0,binary_catalog::nameSize);
+		std::memcpy(descriptor,_names[column].c_str(),_names[column].length());
+		std::memcpy(descriptor+binary_catalog::nameSize,&type,4);
+		std::memcpy(descriptor+binary_catalog::nameSize+4,&unused,4);
+		std::memcpy(descriptor+binary_catalog::nameSize+8,&offset,8);
+	}
+}
+
+void local::BinaryCatalogWriter::_checkColumn(int column, char const *method) const {
+	if(0 == _data) {
+		throw RuntimeError(std::string("BinaryCatalogWriter::") + method + ": already closed.");
+	}
+	if(column < 0 || column >= _ncolumns) {
+		throw RuntimeError(std::string("BinaryCatalogWriter::") + method + ": invalid column index.");
+	}
+}
+
+double *local::BinaryCatalogWriter::getFloat64Column(int column) {
+	_checkColumn(column,"getFloat64Column");
+	if(_type != Float64Column) {
+		throw RuntimeError("BinaryCatalogWriter::getFloat64Column: column type is not Float64Column.");
+	}
+	return reinterpret_cast<double*>(_data + _offsets[column]);
+}
+
+float *local::BinaryCatalogWriter::getFloat32Column(int column) {
+	_checkColumn(column,"getFloat32Column");
+	if(_type != Float32Column) {
+		throw RuntimeError("BinaryCatalogWriter::getFloat32Column: column type is not Float32Column.");
+	}
+	return reinterpret_cast<float*>(_data + _offsets[column]);
+}
+
+void local::BinaryCatalogWriter::setColumn(int column, double const *values, long offset, long n) {
+	_checkColumn(column,"setColumn");
+	if(offset < 0 || n < 0 || offset + n > _nrows) {
+		throw RuntimeError("BinaryCatalogWriter::setColumn: invalid row range.");
+	}
+	if(_type == Float64Column) {
+		std::memcpy(_data + _offsets[column] + offset*sizeof(double),values,n*sizeof(double));
+	}
+	else {
+		float *dest = reinterpret_cast<float*>(_data + _offsets[column]) + offset;
+		for(long i = 0; i < n; ++i) dest[i] = (float)values[i];
+	}
+}
+
+void local::BinaryCatalogWriter::setNumRows(long nrows) {
+	_checkColumn(0,"setNumRows");
+	if(nrows < 0 || nrows > _nrows) {
+		throw RuntimeError("BinaryCatalogWriter::setNumRows: expected 0 <= nrows <= getNumRows().");
+	}
+	if(nrows == _nrows) return;
+	// Columns only move towards the start of the file, so we can compact them in order
+	// without overwriting any values that have not been moved yet.
+	std::vector<std::size_t> oldOffsets(_offsets);
+	_layout(nrows);
+	for(int column = 0; column < _ncolumns; ++column) {
+		std::memmove(_data + _offsets[column],_data + oldOffsets[column],_nrows*_valueSize);
+	}
+	_writeHeader();
+}
+
+void local::BinaryCatalogWriter::close() {
+	if(0 == _data) return;
+	bool ok(true);
+	if(::munmap(_data,_mappedSize) != 0) ok = false;
+	_data = 0;
+	if(_fileSize < _mappedSize && ::ftruncate(_fd,_fileSize) != 0) ok = false;
+	if(::close(_fd) != 0) ok = false;
+	_fd = -1;
+	if(!ok) {
+		throw RuntimeError("BinaryCatalogWriter::close: error while closing " + _filename + ".");
+	}
+}
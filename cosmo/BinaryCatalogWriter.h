@@ -0,0 +1,63 @@
+// Created 16-Oct-2026 by agent <agent@local>
+
+#ifndef COSMO_BINARY_CATALOG_WRITER
+#define COSMO_BINARY_CATALOG_WRITER
+
+#include "cosmo/types.h"
+
+#include <string>
+#include <vector>
+#include <cstddef>
+
+namespace cosmo {
+	class BinaryCatalogWriter {
+	// Creates a binary catalog file with space for a fixed number of rows, and maps it
+	// into memory so that columns can be filled in place. See BinaryCatalogReader for a
+	// description of the file format.
+	public:
+		// Creates (or overwrites) the named file with the specified columns, which all have
+		// the same type, and space for nrows rows. Column values are initially zero.
+		BinaryCatalogWriter(std::string const &filename, std::vector<std::string> const &names,
+			long nrows, CatalogColumnType type = Float64Column);
+		// Calls close() if this has not already been done.
+		virtual ~BinaryCatalogWriter();
+		// Returns the number of columns and rows in this catalog.
+		int getNumColumns() const;
+		long getNumRows() const;
+		// Returns a pointer to the values of the specified column that can be written to
+		// directly. Throws a RuntimeError if the column does not have the requested type.
+		double *getFloat64Column(int column);
+		float *getFloat32Column(int column);
+		// Copies n values into the specified column starting at the specified row,
+		// converting them to the column type if necessary.
+		void setColumn(int column, double const *values, long offset, long n);
+		// Reduces the number of rows in this catalog, keeping the leading nrows values of
+		// each column. Use this when the number of rows is only known as an upper bound
+		// when this object is created.
+		void setNumRows(long nrows);
+		// Updates the file header, releases the mapping and truncates the file to its
+		// final size. No other methods can be used after this.
+		void close();
+	private:
+		// Writers cannot be copied.
+		BinaryCatalogWriter(BinaryCatalogWriter const &other);
+		BinaryCatalogWriter &operator=(BinaryCatalogWriter const &other);
+		void _checkColumn(int column, char const *method) const;
+		void _layout(long nrows);
+		void _writeHeader();
+		std::string _filename;
+		std::vector<std::string> _names;
+		CatalogColumnType _type;
+		int _ncolumns, _fd;
+		long _nrows;
+		std::size_t _valueSize, _mappedSize, _fileSize;
+		std::vector<std::size_t> _offsets;
+		char *_data;
+	}; // BinaryCatalogWriter
+
+	inline int BinaryCatalogWriter::getNumColumns() const { return _ncolumns; }
+	inline long BinaryCatalogWriter::getNumRows() const { return _nrows; }
+
+} // cosmo
+
+#endif // COSMO_BINARY_CATALOG_WRITER
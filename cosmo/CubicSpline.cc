@@ -0,0 +1,114 @@
+// Created 16-Oct-2026 by agent <agent@local>
+
+#include "cosmo/CubicSpline.h"
+#include "cosmo/RuntimeError.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace local = cosmo;
+
+local::CubicSpline::CubicSpline(std::vector<double> const &x)
+: _fitted(false), _uniform(true), _x(x)
+{
+	int n(_x.size());
+	if(n < 2) {
+		throw RuntimeError("CubicSpline: expected at least 2 grid points.");
+	}
+	for(int i = 1; i < n; ++i) {
+		if(_x[i] <= _x[i-1]) {
+			throw RuntimeError("CubicSpline: grid is not increasing.");
+		}
+	}
+	// Check if our grid is uniform to within roundoff.
+	_dx = (_x[n-1]-_x[0])/(n-1);
+	for(int i = 1; i < n-1; ++i) {
+		if(std::fabs(_x[i] - (_x[0] + i*_dx)) > 1e-12*(_x[n-1]-_x[0])) {
+			_uniform = false;
+			break;
+		}
+	}
+	_y.resize(n,0.);
+	_y2.resize(n,0.);
+	// Factorize the tridiagonal system for the second derivatives y2[1..n-2], with
+	// natural boundary conditions y2[0] = y2[n-1] = 0, using the Thomas algorithm.
+	_superDiag.resize(n,0.);
+	_invDiag.resize(n,0.);
+	for(int i = 1; i < n-1; ++i) {
+		double hlo(_x[i]-_x[i-1]), hhi(_x[i+1]-_x[i]);
+		double diag = 2*(hlo+hhi) - hlo*_superDiag[i-1];
+		_invDiag[i] = 1/diag;
+		_superDiag[i] = hhi*_invDiag[i];
+	}
+}
+
+local::CubicSpline::~CubicSpline() { }
+
+void local::CubicSpline::fit(std::vector<double> const &y) {
+	int n(_x.size());
+	if(y.size() != n) {
+		throw RuntimeError("CubicSpline::fit: values have the wrong size.");
+	}
+	std::copy(y.begin(),y.end(),_y.begin());
+	// Forward elimination, saving the intermediate solution in y2.
+	for(int i = 1; i < n-1; ++i) {
+		double hlo(_x[i]-_x[i-1]), hhi(_x[i+1]-_x[i]);
+		double rhs = 6*((_y[i+1]-_y[i])/hhi - (_y[i]-_y[i-1])/hlo);
+		_y2[i] = (rhs - hlo*_y2[i-1])*_invDiag[i];
+	}
+	// Back substitution.
+	for(int i = n-2; i > 0; --i) {
+		_y2[i] -= _superDiag[i]*_y2[i+1];
+	}
+	_fitted = true;
+}
+
+double local::CubicSpline::operator()(double x) const {
+	if(!_fitted) {
+		throw RuntimeError("CubicSpline: spline has not been fit.");
+	}
+	if(x < _x.front() || x > _x.back()) {
+		throw RuntimeError("CubicSpline: x is outside the grid.");
+	}
+	return _evaluate(_getInterval(x),x);
+}
+
+void local::CubicSpline::evaluate(int n, double const *x, double *result) const {
+	if(!_fitted) {
+		throw RuntimeError("CubicSpline: spline has not been fit.");
+	}
+	double xmin(_x.front()), xmax(_x.back());
+	for(int j = 0; j < n; ++j) {
+		if(x[j] < xmin || x[j] > xmax) {
+			throw RuntimeError("CubicSpline::evaluate: x is outside the grid.");
+		}
+	}
+	if(_uniform) {
+		int last(_x.size()-2);
+		for(int j = 0; j < n; ++j) {
+			int i = std::min((int)((x[j]-xmin)/_dx),last);
+			result[j] = _evaluate(i,x[j]);
+		}
+	}
+	else {
+		for(int j = 0; j < n; ++j) result[j] = _evaluate(_getInterval(x[j]),x[j]);
+	}
+}
+
+int local::CubicSpline::_getInterval(double x) const {
+	// Find the interval [x[i],x[i+1]] containing x.
+	int last(_x.size()-2), i;
+	if(_uniform) {
+		i = (int)((x-_x.front())/_dx);
+	}
+	else {
+		i = std::upper_bound(_x.begin(),_x.end(),x) - _x.begin() - 1;
+	}
+	return std::min(i,last);
+}
+
+double local::CubicSpline::_evaluate(int i, double x) const {
+	double h(_x[i+1]-_x[i]);
+	double a((_x[i+1]-x)/h), b(1-a);
+	return a*_y[i] + b*_y[i+1] + ((a*a*a-a)*_y2[i] + (b*b*b-b)*_y2[i+1])*(h*h)/6;
+}
@@ -0,0 +1,52 @@
+// Created 16-Oct-2026 by agent <agent@local>
+
+#ifndef COSMO_CUBIC_SPLINE
+#define COSMO_CUBIC_SPLINE
+
+#include <vector>
+
+namespace cosmo {
+	class CubicSpline {
+	// Interpolates values tabulated on a fixed grid using a natural cubic spline (the
+	// same algorithm as the likely::Interpolator "cspline" option). The grid is fixed
+	// when the spline is created, and the tridiagonal system for the spline coefficients
+	// is factorized once, so that new values can be fit repeatedly in place without
+	// any memory allocation. When the grid is uniformly spaced, the interval containing
+	// each x is calculated directly instead of with a binary search.
+	public:
+		// Creates a new spline on the specified grid, which must contain at least
+		// two strictly increasing values. The spline must be fit before it is used.
+		CubicSpline(std::vector<double> const &x);
+		virtual ~CubicSpline();
+		// Fits the spline to the specified values, which must have the same size as our
+		// grid. Reuses our existing storage, so never allocates memory.
+		void fit(std::vector<double> const &y);
+		// Returns the interpolated value at x, which must lie within our grid.
+		double operator()(double x) const;
+		// Evaluates the spline at n points x[i], which must all lie within our grid, and
+		// saves the results in result[i]. The range is checked once for all points, so
+		// the evaluation loop has no branches when our grid is uniform.
+		void evaluate(int n, double const *x, double *result) const;
+		// Returns true if our grid is uniformly spaced.
+		bool isUniform() const;
+		// Returns true if the spline has been fit.
+		bool isFitted() const;
+		// Returns our grid and the values we were most recently fit to.
+		std::vector<double> const &getX() const;
+		std::vector<double> const &getY() const;
+	private:
+		bool _fitted, _uniform;
+		double _dx;
+		std::vector<double> _x, _y, _y2, _superDiag, _invDiag;
+		int _getInterval(double x) const;
+		double _evaluate(int i, double x) const;
+	}; // CubicSpline
+
+	inline bool CubicSpline::isFitted() const { return _fitted; }
+	inline bool CubicSpline::isUniform() const { return _uniform; }
+	inline std::vector<double> const &CubicSpline::getX() const { return _x; }
+	inline std::vector<double> const &CubicSpline::getY() const { return _y; }
+
+} // cosmo
+
+#endif // COSMO_CUBIC_SPLINE
@@ -4,10 +4,9 @@
 #include "cosmo/TabulatedPower.h"
 #include "cosmo/AdaptiveMultipoleTransform.h"
 #include "cosmo/TransferFunctionPowerSpectrum.h"
+#include "cosmo/KMuPkBatchFunction.h"
 #include "cosmo/RuntimeError.h"
 
-#include "likely/Interpolator.h"
-
 #include "boost/foreach.hpp"
 #include "boost/bind.hpp"
 
@@ -17,11 +16,98 @@
 
 namespace local = cosmo;
 
+namespace cosmo {
+	namespace distorted_power_correlation {
+		// Tabulates the Gauss-Legendre nodes used to project P(k,mu) onto multipoles, with
+		// order nodes in 0 < mu < 1, and the (nell x nnodes) matrix of weights such that
+		// P_ell(k) = P(k)*Sum[ weights(idx,j)*D(k,nodes[j]) ]. When symmetric, only the
+		// positive nodes of the 2*order point rule are used and only even ell are included.
+		void getProjectionRule(int order, int ellMax, bool symmetric,
+		std::vector<double> &nodes, std::vector<double> &weights) {
+			std::vector<double> x, w;
+			getGaussLegendreRule(2*order,x,w);
+			int first = symmetric ? order : 0;
+			nodes.assign(x.begin()+first,x.end());
+			int nnodes(nodes.size()), dell(symmetric ? 2 : 1);
+			weights.clear();
+			weights.reserve((1+ellMax/dell)*nnodes);
+			for(int ell = 0; ell <= ellMax; ell += dell) {
+				for(int j = 0; j < nnodes; ++j) {
+					// Evaluate P_ell(mu) with the three-term recurrence.
+					double mu(nodes[j]), p0(1), p1(mu);
+					for(int n = 2; n <= ell; ++n) {
+						double p2 = ((2*n-1)*mu*p1 - (n-1)*p0)/n;
+						p0 = p1;
+						p1 = p2;
+					}
+					double pell = (ell == 0) ? p0 : p1;
+					// The factor of 2 for symmetric rules accounts for the nodes with mu < 0.
+					double norm = symmetric ? (2*ell+1) : 0.5*(2*ell+1);
+					weights.push_back(norm*w[first+j]*pell);
+				}
+			}
+		}
+		// Returns the slope of the power law through (k1,P1) and (k2,P2), or zero when
+		// these values are (nearly) equal or have different signs, following the rules
+		// used by TabulatedPower for its own power-law extrapolations.
+		double getPowerLawSlope(double k1, double P1, double k2, double P2, double eps = 1e-14) {
+			if(std::fabs(P1-P2) < eps || P1*P2 <= 0) return 0;
+			return std::log(P2/P1)/std::log(k2/k1);
+		}
+	} // distorted_power_correlation
+} // cosmo
+
+local::DistortedPowerCorrelation::Workspace::Workspace(DistortedPowerCorrelation const &dpc,
+KMuPkFunctionCPtr distortion, KMuPkBatchFunctionCPtr batchDistortion)
+: _owner(&dpc), _linearExtrapolation(false)
+{
+	setDistortion(distortion,batchDistortion);
+	int nell(dpc._transformer.size()), nr(dpc._rgrid.size());
+	_pgrid.resize(nell,std::vector<double>(dpc._kgrid.size(),0.));
+	std::size_t npoints(dpc._kgrid.size()*dpc._muNodes.size());
+	_pkgrid.resize(dpc._kgrid.size());
+	_kbuf.resize(npoints);
+	_mubuf.resize(npoints);
+	_pkbuf.resize(npoints);
+	_dbuf.resize(npoints);
+	_savedPowerMultipole.resize(nell);
+	_xiMoments.resize(nell,std::vector<double>(nr,0.));
+	_xiSpline.resize(nell,CubicSpline(dpc._rgrid));
+	// Build the function objects that evaluate each power multipole for arbitrary k
+	// using this workspace.
+	int dell = dpc._symmetric ? 2 : 1;
+	for(int ell = 0; ell <= dpc._ellMax; ell += dell) {
+		_savedPowerFunction.push_back(likely::GenericFunctionPtr(
+			new likely::GenericFunction(boost::bind(
+				&DistortedPowerCorrelation::_getSavedPowerMultipole,&dpc,_1,ell,this))));
+		_directPowerFunction.push_back(likely::GenericFunctionPtr(
+			new likely::GenericFunction(boost::bind(
+				&DistortedPowerCorrelation::_getDirectPowerMultipole,&dpc,_1,ell,this))));
+	}
+}
+
+local::DistortedPowerCorrelation::Workspace::~Workspace() { }
+
+void local::DistortedPowerCorrelation::Workspace::setDistortion(KMuPkFunctionCPtr distortion,
+KMuPkBatchFunctionCPtr batchDistortion) {
+	_distortion = distortion;
+	if(batchDistortion) {
+		_batchDistortion = batchDistortion;
+	}
+	else if(distortion) {
+		_batchDistortion = createKMuPkBatchFunction(distortion);
+	}
+	else {
+		_batchDistortion.reset();
+	}
+}
+
 local::DistortedPowerCorrelation::DistortedPowerCorrelation(likely::GenericFunctionPtr power,
 KMuPkFunctionCPtr distortion, double klo, double khi, int nk, double rmin, double rmax, int nr,
-int ellMax, bool symmetric, double relerr, double abserr, double abspow)
-: _power(power), _distortion(distortion), _ellMax(ellMax), _symmetric(symmetric),
-_relerr(relerr), _abserr(abserr), _abspow(abspow), _initialized(false)
+int ellMax, bool symmetric, double relerr, double abserr, double abspow, int muOrder)
+: _power(power), _distortion(distortion), _batchDistortion(createKMuPkBatchFunction(distortion)),
+_polynomialDegree(0), _relerr(relerr), _abserr(abserr), _abspow(abspow), _ellMax(ellMax),
+_symmetric(symmetric), _initialized(false), _slopeBelow(0), _slopeAbove(0), _basisAccurate(true)
 {	
 	if(khi <= klo) {
 		throw RuntimeError("DistortedPowerCorrelation: expected klo < khi.");
@@ -47,6 +133,10 @@ _relerr(relerr), _abserr(abserr), _abspow(abspow), _initialized(false)
 	if(symmetric && (ellMax%2 == 1)) {
 		throw RuntimeError("DistortedPowerCorrelation: expected even ellMax when symmetric.");
 	}
+	if(muOrder <= 0) {
+		throw RuntimeError("DistortedPowerCorrelation: expected muOrder > 0.");
+	}
+	distorted_power_correlation::getProjectionRule(muOrder,ellMax,symmetric,_muNodes,_muWeights);
 	// Initialize the k grid we will use for interpolation
 	_kgrid.reserve(nk);
 	double dk = std::pow(khi/klo,1./(nk-1.));
@@ -65,9 +155,6 @@ _relerr(relerr), _abserr(abserr), _abspow(abspow), _initialized(false)
 	int dell = symmetric ? 2 : 1;
 	int nell = 1+ellMax/dell;
 	_transformer.reserve(nell);
-	_xiMoments.reserve(nell);
-	_interpolator.reserve(nell);
-	_savedPowerMultipole.reserve(nell);
 	for(int ell = 0; ell <= ellMax; ell += dell) {
 		double coef = multipoleTransformNormalization(ell,3,+1);
 		// Use the same relerr for each ell and share abserr equally. These values will
@@ -75,10 +162,9 @@ _relerr(relerr), _abserr(abserr), _abspow(abspow), _initialized(false)
 		AdaptiveMultipoleTransformPtr amt(new AdaptiveMultipoleTransform(
 			MultipoleTransform::SphericalBessel,ell,coef,_rgrid,relerr/10.,abserr/(2*nell),abspow));
 		_transformer.push_back(amt);
-		_xiMoments.push_back(std::vector<double>(nr,0.));
-		_interpolator.push_back(likely::InterpolatorPtr());
-		_savedPowerMultipole.push_back(cosmo::TabulatedPowerCPtr());
 	}
+	// create the workspace used by our methods that do not take a workspace argument
+	_workspace.reset(new Workspace(*this));
 	// initialize vectors used to find biggest relative contributions
 	std::vector<double>(nell).swap(_rbig);
 	std::vector<double>(nell).swap(_mubig);
@@ -87,6 +173,42 @@ _relerr(relerr), _abserr(abserr), _abspow(abspow), _initialized(false)
 
 local::DistortedPowerCorrelation::~DistortedPowerCorrelation() { }
 
+void local::DistortedPowerCorrelation::setBatchDistortion(KMuPkBatchFunctionCPtr batch) {
+	_batchDistortion = batch ? batch : createKMuPkBatchFunction(_distortion);
+}
+
+void local::DistortedPowerCorrelation::setPolynomialDistortion(
+MuSquaredPolynomialFunctionCPtr coefficients, int degree) {
+	_polynomialWeights.clear();
+	_polynomialDistortion = coefficients;
+	_polynomialDegree = 0;
+	if(!coefficients) return;
+	if(degree < 0) {
+		throw RuntimeError("DistortedPowerCorrelation::setPolynomialDistortion: expected degree >= 0.");
+	}
+	_polynomialDegree = degree;
+	// Our projection rule uses 2*order nodes so integrates polynomials up to degree
+	// 4*order-1 exactly, which covers L_ell(mu)*mu^(2*degree) for all ell <= ellMax.
+	int order = 1 + (2*degree+_ellMax)/4;
+	std::vector<double> nodes, weights;
+	distorted_power_correlation::getProjectionRule(order,_ellMax,_symmetric,nodes,weights);
+	int nnodes(nodes.size()), dell(_symmetric ? 2 : 1);
+	_polynomialWeights.reserve((1+_ellMax/dell)*(degree+1));
+	for(int ell = 0; ell <= _ellMax; ell += dell) {
+		int idx(ell/dell);
+		for(int j = 0; j <= degree; ++j) {
+			// Even powers of mu do not contribute to odd multipoles.
+			double sum(0);
+			if(ell%2 == 0) {
+				for(int m = 0; m < nnodes; ++m) {
+					sum += weights[idx*nnodes+m]*std::pow(nodes[m],2*j);
+				}
+			}
+			_polynomialWeights.push_back(sum);
+		}
+	}
+}
+
 double local::DistortedPowerCorrelation::getPower(double k, double mu) const {
 	if(mu < -1 || mu > 1) {
 		throw RuntimeError("DistortedPowerCorrelation::getPower: expected -1 <= mu <= 1.");
@@ -98,42 +220,181 @@ double local::DistortedPowerCorrelation::getPowerMultipole(double k, int ell) co
 	if(ell < 0 || ell > _ellMax || (_symmetric && (ell%2))) {
 		throw RuntimeError("DistortedPowerCorrelation::getPowerMultipole: invalid ell.");
 	}
-	// Do mu integral of D(k,mu) with fixed k, then multiply result by P(k)
-	likely::GenericFunctionPtr fOfMuPtr(
-		new likely::GenericFunction(boost::bind(*_distortion,k,_1,(*_power)(k))));
-	return (*_power)(k)*getMultipole(fOfMuPtr, ell);
+	return _getPowerMultipole(k,ell,_distortion);
 }
 
-void local::DistortedPowerCorrelation::_initPowerMultipoles() const {
-	// initialize a vector of multipoles
-	int nk(_kgrid.size());
-	std::vector<double> pgrid(nk);
-	// loop over multipoles
-	int dell = _symmetric ? 2 : 1;
-	for(int ell = 0; ell <= _ellMax; ell += dell) {
-		// loop over k values
-		for(int i = 0; i < nk; ++i) {
-			pgrid[i] = getPowerMultipole(_kgrid[i],ell);
+double local::DistortedPowerCorrelation::_getPowerMultipole(double k, int ell,
+KMuPkFunctionCPtr distortion) const {
+	// Project D(k,mu) with fixed k, then multiply the result by P(k)
+	int nnodes(_muNodes.size()), idx(_symmetric ? ell/2 : ell);
+	double const *weights = &_muWeights[idx*nnodes];
+	double pk = (*_power)(k), sum(0);
+	for(int j = 0; j < nnodes; ++j) {
+		sum += weights[j]*(*distortion)(k,_muNodes[j],pk);
+	}
+	return pk*sum;
+}
+
+void local::DistortedPowerCorrelation::_getPowerMultipoles(double k, KMuPkFunctionCPtr distortion,
+std::vector<double> const &nodes, std::vector<double> const &weights, double *result) const {
+	// Evaluate D(k,mu) once per node and accumulate its contribution to each multipole.
+	int nnodes(nodes.size()), nell(weights.size()/nnodes);
+	double pk = (*_power)(k);
+	for(int idx = 0; idx < nell; ++idx) result[idx] = 0;
+	for(int j = 0; j < nnodes; ++j) {
+		double dvalue = pk*(*distortion)(k,nodes[j],pk);
+		for(int idx = 0; idx < nell; ++idx) {
+			result[idx] += weights[idx*nnodes+j]*dvalue;
+		}
+	}
+}
+
+double local::DistortedPowerCorrelation::getProjectionError() const {
+	std::vector<double> nodes2, weights2;
+	int order = _symmetric ? _muNodes.size() : _muNodes.size()/2;
+	distorted_power_correlation::getProjectionRule(2*order,_ellMax,_symmetric,nodes2,weights2);
+	int nell(_transformer.size());
+	std::vector<double> result(nell), result2(nell);
+	double maxDiff(0), maxValue(0);
+	for(int i = 0; i < _kgrid.size(); ++i) {
+		_getPowerMultipoles(_kgrid[i],_distortion,_muNodes,_muWeights,&result[0]);
+		_getPowerMultipoles(_kgrid[i],_distortion,nodes2,weights2,&result2[0]);
+		for(int idx = 0; idx < nell; ++idx) {
+			maxDiff = std::max(maxDiff,std::fabs(result[idx]-result2[idx]));
+			maxValue = std::max(maxValue,std::fabs(result2[idx]));
+		}
+	}
+	return maxValue > 0 ? maxDiff/maxValue : maxDiff;
+}
+
+void local::DistortedPowerCorrelation::_evaluateDistortion(Workspace &workspace, int nk,
+double const *k) const {
+	for(int i = 0; i < nk; ++i) workspace._pkgrid[i] = (*_power)(k[i]);
+	// Calculate the polynomial coefficients of D at each k, if possible.
+	if(_polynomialDistortion && !workspace._distortion) {
+		std::size_t ncoefs((std::size_t)nk*(_polynomialDegree+1));
+		if(workspace._coefbuf.size() < ncoefs) workspace._coefbuf.resize(ncoefs);
+		(*_polynomialDistortion)(nk,k,&workspace._pkgrid[0],&workspace._coefbuf[0]);
+		return;
+	}
+	// Otherwise, evaluate D(k,mu) at every node.
+	_evaluateNodes(workspace,nk,k,workspace._batchDistortion ?
+		*workspace._batchDistortion : *_batchDistortion);
+}
+
+void local::DistortedPowerCorrelation::_evaluateNodes(Workspace &workspace, int nk,
+double const *k, KMuPkBatchFunction const &batch) const {
+	// Fill the workspace buffers with every (k,mu) node, using the P(k) values already
+	// saved in the workspace, and evaluate the batch function at all of them with a
+	// single call.
+	int nnodes(_muNodes.size());
+	for(int i = 0; i < nk; ++i) {
+		for(int j = 0; j < nnodes; ++j) {
+			int index(i*nnodes+j);
+			workspace._kbuf[index] = k[i];
+			workspace._mubuf[index] = _muNodes[j];
+			workspace._pkbuf[index] = workspace._pkgrid[i];
+		}
+	}
+	batch(nk*nnodes,&workspace._kbuf[0],&workspace._mubuf[0],&workspace._pkbuf[0],&workspace._dbuf[0]);
+}
+
+double local::DistortedPowerCorrelation::_projectDistortion(Workspace const &workspace,
+int i, int idx) const {
+	// Project the values saved by the last call to _evaluateDistortion for the i-th k
+	// onto the multipole with index idx, then multiply the result by P(k).
+	if(!_polynomialDistortion || workspace._distortion) return _projectNodes(workspace,i,idx);
+	int ncoefs(_polynomialDegree+1);
+	double const *coefs = &workspace._coefbuf[i*ncoefs];
+	double const *weights = &_polynomialWeights[idx*ncoefs];
+	double sum(0);
+	for(int j = 0; j < ncoefs; ++j) sum += weights[j]*coefs[j];
+	return workspace._pkgrid[i]*sum;
+}
+
+double local::DistortedPowerCorrelation::_projectNodes(Workspace const &workspace,
+int i, int idx) const {
+	int nnodes(_muNodes.size());
+	double const *dvalues = &workspace._dbuf[i*nnodes];
+	double const *weights = &_muWeights[idx*nnodes];
+	double sum(0);
+	for(int j = 0; j < nnodes; ++j) sum += weights[j]*dvalues[j];
+	return workspace._pkgrid[i]*sum;
+}
+
+double local::DistortedPowerCorrelation::_getDirectPowerMultipole(double k, int ell,
+Workspace *workspace) const {
+	_evaluateDistortion(*workspace,1,&k);
+	return _projectDistortion(*workspace,0,_symmetric ? ell/2 : ell);
+}
+
+void local::DistortedPowerCorrelation::_initPowerMultipoles(Workspace &workspace) const {
+	int nk(_kgrid.size()), nell(_transformer.size());
+	_evaluateDistortion(workspace,nk,&_kgrid[0]);
+	// project all multipoles at each k value
+	for(int i = 0; i < nk; ++i) {
+		for(int idx = 0; idx < nell; ++idx) {
+			workspace._pgrid[idx][i] = _projectDistortion(workspace,i,idx);
+		}
+	}
+	// create a tabulated power for each multipole the first time, then update it in place.
+	// Linearly extrapolated multipoles are not extrapolated by the table itself.
+	bool extrapolate(!workspace._linearExtrapolation);
+	for(int idx = 0; idx < nell; ++idx) {
+		if(workspace._savedPowerMultipole[idx]) {
+			workspace._savedPowerMultipole[idx]->update(workspace._pgrid[idx]);
+		}
+		else {
+			workspace._savedPowerMultipole[idx].reset(
+				new cosmo::TabulatedPower(_kgrid,workspace._pgrid[idx],extrapolate,extrapolate));
 		}
-		// create and save a new tabulated power using this grid
-		cosmo::TabulatedPowerCPtr tpptr(new cosmo::TabulatedPower(_kgrid,pgrid,true,true));
-		int idx = _symmetric ? ell/2 : ell;
-		_savedPowerMultipole[idx] = tpptr;
 	}
 }
 
 double local::DistortedPowerCorrelation::getSavedPowerMultipole(double k, int ell) const {
+	return getSavedPowerMultipole(k,ell,*_workspace);
+}
+
+double local::DistortedPowerCorrelation::getSavedPowerMultipole(double k, int ell,
+Workspace const &workspace) const {
 	if(ell < 0 || ell > _ellMax || (_symmetric && (ell%2))) {
 		throw RuntimeError("DistortedPowerCorrelation::getSavedPowerMultipole: invalid ell.");
 	}
+	if(workspace._owner != this) {
+		throw RuntimeError("DistortedPowerCorrelation::getSavedPowerMultipole: invalid workspace.");
+	}
+	return _getSavedPowerMultipole(k,ell,&workspace);
+}
+
+double local::DistortedPowerCorrelation::_getSavedPowerMultipole(double k, int ell,
+Workspace const *workspace) const {
 	int idx = _symmetric ? ell/2 : ell;
-	if(!_savedPowerMultipole[idx]) {
+	if(!workspace->_savedPowerMultipole[idx]) {
 		throw RuntimeError("DistortedPowerCorrelation::getSavedPowerMultipole: not initialized.");
 	}
-	return (*_savedPowerMultipole[idx])(k);
+	if(workspace->_linearExtrapolation) {
+		return _extrapolateLinearly(k,*workspace->_savedPowerMultipole[idx]);
+	}
+	return (*workspace->_savedPowerMultipole[idx])(k);
+}
+
+double local::DistortedPowerCorrelation::_extrapolateLinearly(double k,
+TabulatedPower const &table) const {
+	// Scale the end values of the table with fixed slopes, rather than fitting a power
+	// law to each table, so that the result is linear in the tabulated values.
+	if(k <= 0) return 0;
+	double kmin(_kgrid.front()), kmax(_kgrid.back());
+	if(k < kmin) return table(kmin)*std::pow(k/kmin,_slopeBelow);
+	if(k > kmax) return table(kmax)*std::pow(k/kmax,_slopeAbove);
+	return table(k);
 }
 
 double local::DistortedPowerCorrelation::getCorrelationMultipole(double r, int ell) const {
+	return getCorrelationMultipole(r,ell,*_workspace);
+}
+
+double local::DistortedPowerCorrelation::getCorrelationMultipole(double r, int ell,
+Workspace const &workspace) const {
 	if(!isInitialized()) {
 		throw RuntimeError("DistortedPowerCorrelation::getCorrelationMultipole: not initialized.");
 	}
@@ -143,11 +404,22 @@ double local::DistortedPowerCorrelation::getCorrelationMultipole(double r, int e
 	if(r < _rgrid.front() || r > _rgrid.back()) {
 		throw RuntimeError("DistortedPowerCorrelation::getCorrelationMultipole: r out of range.");
 	}
+	if(workspace._owner != this) {
+		throw RuntimeError("DistortedPowerCorrelation::getCorrelationMultipole: invalid workspace.");
+	}
 	int idx = _symmetric ? ell/2 : ell;
-	return (*_interpolator[idx])(r);
+	if(!workspace._xiSpline[idx].isFitted()) {
+		throw RuntimeError("DistortedPowerCorrelation::getCorrelationMultipole: workspace not transformed.");
+	}
+	return workspace._xiSpline[idx](r);
 }
 
 double local::DistortedPowerCorrelation::getCorrelation(double r, double mu) const {
+	return getCorrelation(r,mu,*_workspace);
+}
+
+double local::DistortedPowerCorrelation::getCorrelation(double r, double mu,
+Workspace const &workspace) const {
 	if(!isInitialized()) {
 		throw RuntimeError("DistortedPowerCorrelation::getCorrelation: not initialized.");
 	}
@@ -157,7 +429,7 @@ double local::DistortedPowerCorrelation::getCorrelation(double r, double mu) con
 	double result(0);
 	int dell = _symmetric ? 2 : 1;
 	for(int ell = 0; ell <= _ellMax; ell += dell) {
-		result += getCorrelationMultipole(r,ell)*legendreP(ell,mu);
+		result += getCorrelationMultipole(r,ell,workspace)*legendreP(ell,mu);
 	}
 	return result;
 }
@@ -176,22 +448,30 @@ double margin, double vepsMax, double vepsMin, bool optimize) {
 	if(vepsMin <= 0) {
 		throw RuntimeError("DistortedPowerCorrelation::initialize: expected vepsMin > 0.");
 	}
+	// Find the slopes of P(k) at each end of our k grid, using the same points and rules as
+	// the power-law extrapolations of our tabulated power multipoles, so that a linear
+	// extrapolation agrees with them when D(k,mu) does not depend on k.
+	int nk(_kgrid.size());
+	if(nk < 3) {
+		throw RuntimeError("DistortedPowerCorrelation::initialize: need nk >= 3 for extrapolation.");
+	}
+	_slopeBelow = distorted_power_correlation::getPowerLawSlope(
+		_kgrid[0],(*_power)(_kgrid[0]),_kgrid[2],(*_power)(_kgrid[2]));
+	_slopeAbove = distorted_power_correlation::getPowerLawSlope(
+		_kgrid[nk-3],(*_power)(_kgrid[nk-3]),_kgrid[nk-1],(*_power)(_kgrid[nk-1]));
 	// Initialize our tabulated power multipoles
-	_initPowerMultipoles();
+	Workspace &workspace(*_workspace);
+	_initPowerMultipoles(workspace);
 	// Loop over multipoles
 	int dell = _symmetric ? 2 : 1;
 	for(int ell = 0; ell <= _ellMax; ell += dell) {
 		int idx(ell/dell);
-		// Build a function object that evaluates this multipole for arbitrary k
-		likely::GenericFunctionPtr fOfKPtr(
-			new likely::GenericFunction(boost::bind(
-				&DistortedPowerCorrelation::getSavedPowerMultipole,this,_1,ell)));
 		// Do not optimize now
 		bool noOptimize(false);
-		_transformer[idx]->initialize(fOfKPtr,_xiMoments[idx],_minSamplesPerDecade,margin,
-			vepsMax,vepsMin,noOptimize);
-		// (re)create the interpolator for this moment
-		_interpolator[idx].reset(new likely::Interpolator(_rgrid,_xiMoments[idx],"cspline"));
+		_transformer[idx]->initialize(workspace._savedPowerFunction[idx],workspace._xiMoments[idx],
+			_minSamplesPerDecade,margin,vepsMax,vepsMin,noOptimize);
+		// refit the interpolating spline for this moment
+		workspace._xiSpline[idx].fit(workspace._xiMoments[idx]);
 	}
 	// Loop over our (r,mu) evaluation grid.
 	double dmu = 2./dell/(nmu-1.);
@@ -203,10 +483,10 @@ double margin, double vepsMax, double vepsMin, bool optimize) {
 		for(int i = 0; i < nmu; ++i) {
 			double mu = 1. - i*dmu;
 			// Loop over multipoles to calculate their relative contributions at (r,mu)
-			double xisum;
+			double xisum(0);
 			for(int ell = 0; ell <= _ellMax; ell += dell) {
 				int idx = _symmetric ? ell/2 : ell;
-				double term = (*_interpolator[idx])(r)*legendreP(ell,mu);
+				double term = workspace._xiSpline[idx](r)*legendreP(ell,mu);
 				contribution[idx] = term;
 				xisum += term;
 			}
@@ -233,42 +513,180 @@ double margin, double vepsMax, double vepsMin, bool optimize) {
 		AdaptiveMultipoleTransformPtr amt(new AdaptiveMultipoleTransform(
 			MultipoleTransform::SphericalBessel,ell,coef,_rgrid,relerr,abserr,_abspow));
 		_transformer[idx] = amt;
-		// Build a function object that evaluates this multipole for arbitrary k
-		likely::GenericFunctionPtr fOfKPtr(
-			new likely::GenericFunction(boost::bind(
-				&DistortedPowerCorrelation::getSavedPowerMultipole,this,_1,ell)));
 		// Initialize our new transformer (with optimization, if requested)
-		_transformer[idx]->initialize(fOfKPtr,_xiMoments[idx],_minSamplesPerDecade,margin,
-			vepsMax,vepsMin,optimize);
-		// (re)create the interpolator for this moment
-		_interpolator[idx].reset(new likely::Interpolator(_rgrid,_xiMoments[idx],"cspline"));
+		_transformer[idx]->initialize(workspace._savedPowerFunction[idx],workspace._xiMoments[idx],
+			_minSamplesPerDecade,margin,vepsMax,vepsMin,optimize);
+		// refit the interpolating spline for this moment
+		workspace._xiSpline[idx].fit(workspace._xiMoments[idx]);
 	}
 	_initialized = true;
+	// Transform each registered basis distortion with our final transformers.
+	if(_basis.size() > 0) {
+		Workspace basisWorkspace(*this);
+		basisWorkspace._linearExtrapolation = true;
+		_basisAccurate = true;
+		for(int b = 0; b < _basis.size(); ++b) _transformBasis(b,basisWorkspace);
+	}
+}
+
+int local::DistortedPowerCorrelation::addBasisDistortion(KMuPkFunctionCPtr basis,
+KMuPkBatchFunctionCPtr batchBasis) {
+	if(!basis) {
+		throw RuntimeError("DistortedPowerCorrelation::addBasisDistortion: expected a basis function.");
+	}
+	int b(_basis.size()), nell(_transformer.size());
+	_basis.push_back(basis);
+	_batchBasis.push_back(batchBasis);
+	_basisXi.resize(_basisXi.size()+nell,std::vector<double>(_rgrid.size(),0.));
+	if(isInitialized()) {
+		Workspace basisWorkspace(*this);
+		basisWorkspace._linearExtrapolation = true;
+		_transformBasis(b,basisWorkspace);
+	}
+	return b;
+}
+
+void local::DistortedPowerCorrelation::_transformBasis(int b, Workspace &workspace) {
+	workspace.setDistortion(_basis[b],_batchBasis[b]);
+	_initPowerMultipoles(workspace);
+	int nell(_transformer.size());
+	for(int idx = 0; idx < nell; ++idx) {
+		_basisAccurate &= _transformer[idx]->transform(workspace._savedPowerFunction[idx],
+			_basisXi[b*nell+idx],workspace._amtWorkspace);
+	}
+}
+
+bool local::DistortedPowerCorrelation::combineBasis(std::vector<double> const &coefficients) const {
+	return combineBasis(coefficients,*_workspace);
+}
+
+bool local::DistortedPowerCorrelation::combineBasis(std::vector<double> const &coefficients,
+Workspace &workspace) const {
+	if(!isInitialized()) {
+		throw RuntimeError("DistortedPowerCorrelation::combineBasis: not initialized.");
+	}
+	if(workspace._owner != this) {
+		throw RuntimeError("DistortedPowerCorrelation::combineBasis: invalid workspace.");
+	}
+	int nbasis(_basis.size()), nell(_transformer.size()), nr(_rgrid.size());
+	if(coefficients.size() != nbasis) {
+		throw RuntimeError("DistortedPowerCorrelation::combineBasis: expected one coefficient per basis.");
+	}
+	for(int idx = 0; idx < nell; ++idx) {
+		std::vector<double> &xi(workspace._xiMoments[idx]);
+		std::fill(xi.begin(),xi.end(),0.);
+		for(int b = 0; b < nbasis; ++b) {
+			double coef(coefficients[b]);
+			if(coef == 0) continue;
+			double const *basisXi = &_basisXi[b*nell+idx][0];
+			for(int i = 0; i < nr; ++i) xi[i] += coef*basisXi[i];
+		}
+		// refit the interpolating spline for this moment
+		workspace._xiSpline[idx].fit(xi);
+	}
+	return _basisAccurate;
 }
 
 bool local::DistortedPowerCorrelation::transform(
 bool interpolatePowerMultipoles, bool bypassTerminationTest) const {
+	return transform(*_workspace,interpolatePowerMultipoles,bypassTerminationTest);
+}
+
+bool local::DistortedPowerCorrelation::transform(Workspace &workspace,
+bool interpolatePowerMultipoles, bool bypassTerminationTest) const {
+	if(!isInitialized()) {
+		throw RuntimeError("DistortedPowerCorrelation::transform: not initialized.");
+	}
+	if(workspace._owner != this) {
+		throw RuntimeError("DistortedPowerCorrelation::transform: invalid workspace.");
+	}
 	bool accurate(true);
 	// Initialize our tabulated power multipoles if requested
-	if(interpolatePowerMultipoles) _initPowerMultipoles();
+	if(interpolatePowerMultipoles) _initPowerMultipoles(workspace);
 	// Loop over multipoles
 	int dell = _symmetric ? 2 : 1;
 	for(int ell = 0; ell <= _ellMax; ell += dell) {
 		int idx(ell/dell);
-		// Build a function object that evaluates this multipole for arbitrary k
-		likely::GenericFunctionPtr fOfKPtr(
+		likely::GenericFunctionPtr fOfKPtr = interpolatePowerMultipoles ?
+			workspace._savedPowerFunction[idx] : workspace._directPowerFunction[idx];
+		accurate &= _transformer[idx]->transform(fOfKPtr,workspace._xiMoments[idx],
+			workspace._amtWorkspace,bypassTerminationTest);
+		// refit the interpolating spline for this moment
+		workspace._xiSpline[idx].fit(workspace._xiMoments[idx]);
+	}
+	return accurate;
+}
+
+bool local::DistortedPowerCorrelation::transformDerivatives(
+std::vector<KMuPkBatchFunctionCPtr> const &derivatives, std::vector<std::vector<double> > &results,
+bool bypassTerminationTest) const {
+	return transformDerivatives(derivatives,results,*_workspace,bypassTerminationTest);
+}
+
+bool local::DistortedPowerCorrelation::transformDerivatives(
+std::vector<KMuPkBatchFunctionCPtr> const &derivatives, std::vector<std::vector<double> > &results,
+Workspace &workspace, bool bypassTerminationTest) const {
+	if(!isInitialized()) {
+		throw RuntimeError("DistortedPowerCorrelation::transformDerivatives: not initialized.");
+	}
+	if(workspace._owner != this) {
+		throw RuntimeError("DistortedPowerCorrelation::transformDerivatives: invalid workspace.");
+	}
+	int nparam(derivatives.size()), nell(_transformer.size()), nk(_kgrid.size());
+	for(int p = 0; p < nparam; ++p) {
+		if(!derivatives[p]) {
+			throw RuntimeError("DistortedPowerCorrelation::transformDerivatives: missing derivative.");
+		}
+	}
+	// Create the storage for any parameters that this workspace has not seen before.
+	for(int index = workspace._derivativePower.size(); index < nparam*nell; ++index) {
+		workspace._derivativeGrid.push_back(std::vector<double>(nk,0.));
+		workspace._derivativePower.push_back(cosmo::TabulatedPowerPtr());
+		workspace._derivativeFunction.push_back(likely::GenericFunctionPtr(
 			new likely::GenericFunction(boost::bind(
-				(interpolatePowerMultipoles ?
-					&DistortedPowerCorrelation::getSavedPowerMultipole :
-					&DistortedPowerCorrelation::getPowerMultipole
-				),this,_1,ell)));
-		accurate &= _transformer[idx]->transform(fOfKPtr,_xiMoments[idx],bypassTerminationTest);
-		// (re)create the interpolator for this moment
-		_interpolator[idx].reset(new likely::Interpolator(_rgrid,_xiMoments[idx],"cspline"));
+				&DistortedPowerCorrelation::_getDerivativePowerMultipole,this,_1,index,&workspace))));
+	}
+	workspace._derivativeBatch.resize(nparam);
+	workspace._derivativeResults.resize(nparam);
+	// Project each derivative onto multipoles on our k grid.
+	for(int i = 0; i < nk; ++i) workspace._pkgrid[i] = (*_power)(_kgrid[i]);
+	for(int p = 0; p < nparam; ++p) {
+		_evaluateNodes(workspace,nk,&_kgrid[0],*derivatives[p]);
+		for(int idx = 0; idx < nell; ++idx) {
+			int index(p*nell+idx);
+			std::vector<double> &grid(workspace._derivativeGrid[index]);
+			for(int i = 0; i < nk; ++i) grid[i] = _projectNodes(workspace,i,idx);
+			if(workspace._derivativePower[index]) {
+				workspace._derivativePower[index]->update(grid);
+			}
+			else {
+				// The derivative tables are extrapolated linearly by _getDerivativePowerMultipole.
+				workspace._derivativePower[index].reset(new cosmo::TabulatedPower(_kgrid,grid));
+			}
+		}
+	}
+	// Transform all parameters together for each multipole.
+	if(results.size() != nparam*nell) results.resize(nparam*nell);
+	bool accurate(true);
+	for(int idx = 0; idx < nell; ++idx) {
+		for(int p = 0; p < nparam; ++p) {
+			workspace._derivativeBatch[p] = workspace._derivativeFunction[p*nell+idx];
+			workspace._derivativeResults[p].swap(results[p*nell+idx]);
+		}
+		accurate &= _transformer[idx]->transformBatch(workspace._derivativeBatch,
+			workspace._derivativeResults,workspace._amtWorkspace,bypassTerminationTest);
+		for(int p = 0; p < nparam; ++p) {
+			workspace._derivativeResults[p].swap(results[p*nell+idx]);
+		}
 	}
 	return accurate;
 }
 
+double local::DistortedPowerCorrelation::_getDerivativePowerMultipole(double k, int index,
+Workspace const *workspace) const {
+	return _extrapolateLinearly(k,*workspace->_derivativePower[index]);
+}
+
 local::AdaptiveMultipoleTransformCPtr local::DistortedPowerCorrelation::getTransform(int ell) const {
 	if(ell < 0 || ell > _ellMax || (_symmetric && (ell%2))) {
 		throw RuntimeError("DistortedPowerCorrelation::getTransform: invalid ell.");
@@ -302,6 +720,14 @@ void local::DistortedPowerCorrelation::printToStream(std::ostream &out) const {
     	<< _rgrid.front() << ',' << _rgrid.back() << "] Mpc/h" << std::endl;
 	out << "using " << (_symmetric ? "even" : "even+odd") << " multipoles up to ell = "
 		<< _ellMax << std::endl;
+	if(_polynomialDistortion) {
+		out << "multipoles projected exactly from a degree " << _polynomialDegree
+			<< " polynomial in mu^2" << std::endl;
+	}
+	else {
+		out << "multipoles projected using " << _muNodes.size() << " Gauss-Legendre mu nodes "
+			<< "(relative error " << getProjectionError() << " from doubling nodes)" << std::endl;
+	}
     for(int ell = 0; ell <= _ellMax; ell += dell) {
         getBiggestContribution(ell,r,mu,rel);
         cosmo::AdaptiveMultipoleTransformCPtr amt = getTransform(ell);
@@ -4,6 +4,8 @@
 #define COSMO_DISTORTED_POWER_CORRELATION
 
 #include "cosmo/types.h"
+#include "cosmo/AdaptiveMultipoleTransform.h"
+#include "cosmo/CubicSpline.h"
 #include "likely/types.h"
 #include "likely/function.h"
 
@@ -13,7 +15,6 @@
 #include <iosfwd>
 
 namespace cosmo {
-	class AdaptiveMultipoleTransform;
 	class DistortedPowerCorrelation {
 	// Represents the 3D correlation function corresponding to an isotropic power
 	// spectrum P(k) that is distorted by a multiplicative function D(k,mu_k).
@@ -30,7 +31,58 @@ namespace cosmo {
 	// numerical tolerances that should be sufficient for "small" variations
 	// of D(k,mu_k). Note that initialize() includes the work of transform(),
 	// so the transform() step can be skipped for the initial D(k,mu_k).
+	//
+	// After initialize(), the numerical setup is never modified so one object can be
+	// shared by several threads that each transform a different D(k,mu_k) into their
+	// own Workspace, using the methods below that take a workspace argument.
 	public:
+		class Workspace {
+		// Holds the results of transforming one distortion function, and the scratch
+		// memory needed to calculate them. A workspace must not be used by more than
+		// one thread at a time.
+		public:
+			// Creates a new workspace for transforms using the specified correlation
+			// object. If a distortion function is provided, it is used instead of the
+			// distortion that the correlation object was created with, and transforms
+			// evaluate it via the optional batch function, or else via an adapter that
+			// calls the scalar function at each point.
+			Workspace(DistortedPowerCorrelation const &dpc,
+				KMuPkFunctionCPtr distortion = KMuPkFunctionCPtr(),
+				KMuPkBatchFunctionCPtr batchDistortion = KMuPkBatchFunctionCPtr());
+			virtual ~Workspace();
+			// Sets the distortion function to use for subsequent transforms with this
+			// workspace, or restores the default distortion when distortion is empty.
+			// The optional batch function is used as described for our constructor.
+			void setDistortion(KMuPkFunctionCPtr distortion,
+				KMuPkBatchFunctionCPtr batchDistortion = KMuPkBatchFunctionCPtr());
+		private:
+			friend class DistortedPowerCorrelation;
+			DistortedPowerCorrelation const *_owner;
+			KMuPkFunctionCPtr _distortion;
+			KMuPkBatchFunctionCPtr _batchDistortion;
+			// Set for the workspaces used to transform basis distortions, so that their
+			// power multipoles are extrapolated linearly beyond our k grid.
+			bool _linearExtrapolation;
+			// All of the storage below is created on first use and then reused, so that
+			// repeated transforms do not allocate any memory.
+			std::vector<std::vector<double> > _pgrid;
+			// Buffers of (k,mu,P(k),D) for a batch evaluation of the distortion at every
+			// (k,mu) node of our grid.
+			std::vector<double> _kbuf, _mubuf, _pkbuf, _dbuf;
+			// Buffers of P(k) and the polynomial coefficients of D at each k.
+			std::vector<double> _pkgrid, _coefbuf;
+			// Tabulated derivative power multipoles and the corresponding functions,
+			// indexed by p*nell+idx, and the per-multipole batch arguments and results.
+			std::vector<std::vector<double> > _derivativeGrid;
+			std::vector<cosmo::TabulatedPowerPtr> _derivativePower;
+			std::vector<likely::GenericFunctionPtr> _derivativeFunction, _derivativeBatch;
+			std::vector<std::vector<double> > _derivativeResults;
+			std::vector<cosmo::TabulatedPowerPtr> _savedPowerMultipole;
+			std::vector<likely::GenericFunctionPtr> _savedPowerFunction, _directPowerFunction;
+			std::vector<std::vector<double> > _xiMoments;
+			std::vector<CubicSpline> _xiSpline;
+			AdaptiveMultipoleTransform::Workspace _amtWorkspace;
+		}; // DistortedPowerCorrelation::Workspace
 		// Creates a new distorted power correlation function using the specified
 		// isotropic power P(k) and distortion function D(k,mu). The k-space multipoles
 		// of D(k,mu)*P(k) will be tabulated using nk logarithmically spaced points
@@ -41,19 +93,27 @@ namespace cosmo {
 		// The desired accuracy is specified by relerr, abserr, and abspow, such that
 		// the difference between the true and estimated xi(r,mu) satisfies:
 		// |true-est| < max(abserr*r^abspow,true*true)
+		// The k-space multipoles are projected with a Gauss-Legendre rule that has muOrder
+		// nodes in 0 < mu < 1 (and the same number in -1 < mu < 0 unless symmetric), so
+		// that D(k,mu) is evaluated once per node for all multipoles.
 		DistortedPowerCorrelation(likely::GenericFunctionPtr power, KMuPkFunctionCPtr distortion,
 			double klo, double khi, int nk, double rmin, double rmax, int nr,
 			int ellMax, bool symmetric = true,
-			double relerr = 1e-2, double abserr = 1e-3, double abspow = 0);
+			double relerr = 1e-2, double abserr = 1e-3, double abspow = 0, int muOrder = 16);
 		virtual ~DistortedPowerCorrelation();
 		// Returns the value of P(k,mu) = P(k)*D(k,mu). This is fast to evaluate and
 		// does not require that initialize() be called first.
 		double getPower(double k, double mu) const;
 		// Returns the specified multipole of P(k,mu) evaluated at k. This method calculates
-		// the relevant numerical 1D integral each time it is called, so is relatively slow,
+		// the Gauss-Legendre projection each time it is called, so is relatively slow,
 		// but does not require that initialize() be called first. After initialize() or
 		// transform() has been called, the getSavedPowerMultipole() function is faster.
 		double getPowerMultipole(double k, int ell) const;
+		// Estimates the accuracy of our Gauss-Legendre projection onto multipoles by
+		// comparing with a rule that has twice as many nodes, over our k grid and all
+		// multipoles. Returns the largest absolute difference divided by the largest
+		// absolute multipole value.
+		double getProjectionError() const;
 		// Returns the specified multipole of P(k,mu) evaluated at k. This method interpolates
 		// in k-space multipoles tabulated during the last call to initialize() or transform(),
 		// so does not reflect more recent changes to P(k,mu) but is generally faster than
@@ -75,13 +135,91 @@ namespace cosmo {
 		// specified in our constructor.
 		void initialize(int nmu = 20, double margin = 2,
 			double vepsMax = 0.01, double vepsMin = 1e-6, bool optimize = false);
+		// Sets a batch implementation of our distortion function that transforms will use
+		// to evaluate D(k,mu) at all of our (k,mu) nodes with a single call, unless a
+		// workspace provides its own distortion. The batch function must agree with the
+		// scalar distortion passed to our constructor, which is still used by getPower()
+		// and getPowerMultipole(). Passing an empty pointer restores the default adapter
+		// that calls the scalar function at each point. This method should not be called
+		// while other threads are transforming with this object.
+		void setBatchDistortion(KMuPkBatchFunctionCPtr batch);
+		// Declares that our distortion is a polynomial in mu^2 of the specified degree,
+		// with k-dependent coefficients calculated by the function provided. Transforms
+		// then compute the power multipoles from these coefficients with an exact
+		// projection of each mu^(2j) onto Legendre polynomials, instead of evaluating
+		// D(k,mu) at each Gauss-Legendre node, unless a workspace provides its own
+		// distortion. The coefficients must agree with the scalar distortion passed to
+		// our constructor, which is still used by getPower() and getPowerMultipole().
+		// Passing an empty pointer restores the default projection. This method should
+		// not be called while other threads are transforming with this object.
+		void setPolynomialDistortion(MuSquaredPolynomialFunctionCPtr coefficients, int degree);
 		// Tests if we have ever been initialized.
 		bool isInitialized() const;
 		// Transforms the k-space power multipoles to r space. Returns true if the termination
 		// criteria are met, unless bypassTerminationTest is true (in which case we
 		// always return true and transforms will be somewhat faster).
+		// This method uses an internal workspace so is not thread safe.
 		bool transform(bool interpolatePowerMultipoles = true,
 			bool bypassTerminationTest = false) const;
+		// Same as above but saves results in the workspace provided, which must have been
+		// created for this object. Requires that initialize() be called first. All
+		// buffers and spline coefficients are reused in place, so repeated calls with
+		// the same workspace do not allocate memory after the first. This
+		// method is thread safe as long as each thread uses a different workspace, and
+		// P(k) and the workspace distortion function are safe to call concurrently.
+		bool transform(Workspace &workspace, bool interpolatePowerMultipoles = true,
+			bool bypassTerminationTest = false) const;
+		// Registers a basis distortion function B(k,mu), and optional batch form, and
+		// returns its index. Each basis is transformed once, by initialize() or immediately
+		// if we are already initialized, and its correlation multipoles are cached. When
+		// P(k,mu) is linear in some parameters, D(k,mu) = Sum[ c_b*B_b(k,mu) ], this allows
+		// combineBasis() to replace transform() for each new parameter vector. Basis power
+		// multipoles are extrapolated beyond [klo,khi] using the power-law slopes of P(k)
+		// at each end of our k grid, which is linear in the basis and so agrees with the
+		// extrapolation used by transform() whenever D(k,mu) does not depend on k there.
+		int addBasisDistortion(KMuPkFunctionCPtr basis,
+			KMuPkBatchFunctionCPtr batchBasis = KMuPkBatchFunctionCPtr());
+		// Returns the number of registered basis distortions.
+		int getNumBasisDistortions() const;
+		// Sets the correlation multipoles to the linear combination of the cached basis
+		// multipoles with the coefficients provided, one per basis, at a cost of
+		// O(nbasis*nr) per multipole instead of a full transform. Results are available
+		// via getCorrelation() and getCorrelationMultipole(), but the saved power multipoles
+		// are not updated. Returns true if every basis transform met its termination
+		// criteria. This method uses an internal workspace so is not thread safe.
+		bool combineBasis(std::vector<double> const &coefficients) const;
+		// Same as above but saves results in the workspace provided, which must have been
+		// created for this object. This method does not allocate memory and is thread safe
+		// as long as each thread uses a different workspace.
+		bool combineBasis(std::vector<double> const &coefficients, Workspace &workspace) const;
+		// Calculates the derivatives of our correlation multipoles with respect to nparam
+		// parameters, given the derivative dD/dtheta_p of the distortion function with
+		// respect to each parameter. Each multipole transform is linear in P_ell(k) when
+		// P_ell(k) is extrapolated linearly beyond [klo,khi], as described for
+		// addBasisDistortion(), so the derivatives are the transforms of the projections
+		// of P(k)*dD/dtheta_p, extrapolated in the same way, which are calculated for all parameters together with one batched transform per
+		// multipole on the same u grids used by transform(). Use createKMuPkBatchFunction()
+		// to adapt scalar derivative functions. Results are saved in the vector provided,
+		// which will be resized if necessary, with results[p*nell+idx] the derivative of
+		// the multipole with index idx (ell = idx or 2*idx when symmetric) at each point
+		// of our r grid. Returns true if the termination criteria are met, unless
+		// bypassTerminationTest is true. Requires that initialize() be called first.
+		// Storage for each parameter is created on first use and then reused. This
+		// method uses an internal workspace so is not thread safe.
+		bool transformDerivatives(std::vector<KMuPkBatchFunctionCPtr> const &derivatives,
+			std::vector<std::vector<double> > &results, bool bypassTerminationTest = false) const;
+		// Same as above but uses the workspace provided, which must have been created for
+		// this object, and is then thread safe as for transform(workspace,...).
+		bool transformDerivatives(std::vector<KMuPkBatchFunctionCPtr> const &derivatives,
+			std::vector<std::vector<double> > &results, Workspace &workspace,
+			bool bypassTerminationTest = false) const;
+		// Returns the r grid where correlation multipoles are tabulated.
+		std::vector<double> const &getRGrid() const;
+		// Returns values calculated with the workspace provided, after the last call to
+		// transform(workspace,...). See the corresponding methods above for details.
+		double getSavedPowerMultipole(double k, int ell, Workspace const &workspace) const;
+		double getCorrelationMultipole(double r, int ell, Workspace const &workspace) const;
+		double getCorrelation(double r, double mu, Workspace const &workspace) const;
 		// Returns a shared const pointer to the specified transform.
 		AdaptiveMultipoleTransformCPtr getTransform(int ell) const;
 		// Fills the variables provided with the (r,mu) coordinates where the specified
@@ -96,18 +234,49 @@ namespace cosmo {
 	private:
 		likely::GenericFunctionPtr _power;
 		KMuPkFunctionCPtr _distortion;
+		KMuPkBatchFunctionCPtr _batchDistortion;
+		MuSquaredPolynomialFunctionCPtr _polynomialDistortion;
+		int _polynomialDegree;
 		double _relerr,_abserr,_abspow;
 		int _ellMax, _minSamplesPerDecade;
 		bool _symmetric, _initialized;
 		std::vector<double> _kgrid, _rgrid, _rbig, _mubig, _relbig;
-		void _initPowerMultipoles() const;
-		mutable std::vector<cosmo::TabulatedPowerCPtr> _savedPowerMultipole;
-		mutable std::vector<std::vector<double> > _xiMoments;
-		mutable std::vector<likely::InterpolatorPtr> _interpolator;
+		// Power-law slopes of P(k) at each end of our k grid, used to extrapolate the
+		// basis and derivative power multipoles.
+		double _slopeBelow, _slopeAbove;
+		// Gauss-Legendre nodes in mu and the corresponding (nell x nnodes) matrix of
+		// projection weights for each multipole.
+		std::vector<double> _muNodes, _muWeights;
+		// The (nell x (degree+1)) matrix of exact projections of mu^(2j) onto each
+		// multipole, used with a polynomial distortion.
+		std::vector<double> _polynomialWeights;
 		std::vector<AdaptiveMultipoleTransformPtr> _transformer;
+		// Registered basis distortions and their cached correlation multipoles, indexed
+		// by b*nell+idx, with a flag for whether all of their transforms were accurate.
+		std::vector<KMuPkFunctionCPtr> _basis;
+		std::vector<KMuPkBatchFunctionCPtr> _batchBasis;
+		std::vector<std::vector<double> > _basisXi;
+		bool _basisAccurate;
+		boost::scoped_ptr<Workspace> _workspace;
+		double _getPowerMultipole(double k, int ell, KMuPkFunctionCPtr distortion) const;
+		void _getPowerMultipoles(double k, KMuPkFunctionCPtr distortion, std::vector<double> const &nodes,
+			std::vector<double> const &weights, double *result) const;
+		double _getSavedPowerMultipole(double k, int ell, Workspace const *workspace) const;
+		double _getDirectPowerMultipole(double k, int ell, Workspace *workspace) const;
+		void _evaluateDistortion(Workspace &workspace, int nk, double const *k) const;
+		void _evaluateNodes(Workspace &workspace, int nk, double const *k,
+			KMuPkBatchFunction const &batch) const;
+		double _projectDistortion(Workspace const &workspace, int i, int idx) const;
+		double _projectNodes(Workspace const &workspace, int i, int idx) const;
+		double _getDerivativePowerMultipole(double k, int index, Workspace const *workspace) const;
+		double _extrapolateLinearly(double k, TabulatedPower const &table) const;
+		void _initPowerMultipoles(Workspace &workspace) const;
+		void _transformBasis(int b, Workspace &workspace);
 	}; // DistortedPowerCorrelation
 
 	inline bool DistortedPowerCorrelation::isInitialized() const { return _initialized; }
+	inline int DistortedPowerCorrelation::getNumBasisDistortions() const { return _basis.size(); }
+	inline std::vector<double> const &DistortedPowerCorrelation::getRGrid() const { return _rgrid; }
 
 } // cosmo
 
@@ -1,7 +1,9 @@
 // Created 20-Mar-2014 by Michael Blomqvist (University of California, Irvine) <cblomqvi@uci.edu>
 
 #include "cosmo/DistortedPowerCorrelationFft.h"
+#include "cosmo/KMuPkBatchFunction.h"
 #include "cosmo/RuntimeError.h"
+#include "cosmo/FftwPlanner.h"
 
 #include "likely/BiCubicInterpolator.h"
 
@@ -15,20 +17,41 @@
 #define FFTW(X) fftwf_ ## X // prefix identifier (float transform)
 #endif
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace local = cosmo;
 
 namespace cosmo {
     struct DistortedPowerCorrelationFft::Implementation {
 #ifdef HAVE_LIBFFTW3F
+        // The full 3D complex grid used for the general transform.
         FFTW(complex) *data;
+        // The real (kx,ky) plane of the octant summed over kz, used for the symmetric transform.
+        float *plane;
         FFTW(plan) plan;
 #endif
     };
+    namespace distorted_power_correlation_fft {
+        // Returns the number of threads to use for a requested value nthreads.
+        int getNumThreads(int nthreads) {
+            if(nthreads > 0) return nthreads;
+#ifdef _OPENMP
+            return omp_get_max_threads();
+#else
+            return 1;
+#endif
+        }
+    }
 }
 
 local::DistortedPowerCorrelationFft::DistortedPowerCorrelationFft(likely::GenericFunctionPtr power,
-KMuPkFunctionCPtr distortion, double spacing, int nx, int ny, int nz)
-: _power(power), _distortion(distortion), _spacing(spacing), _nx(nx), _ny(ny), _nz(nz), _pimpl(new Implementation())
+KMuPkFunctionCPtr distortion, double spacing, int nx, int ny, int nz,
+MultipoleTransform::Strategy strategy, int nthreads, bool symmetric)
+: _power(power), _distortion(distortion), _batchDistortion(createKMuPkBatchFunction(distortion)),
+_spacing(spacing), _nx(nx), _ny(ny), _nz(nz),
+_symmetric(symmetric), _pimpl(new Implementation())
 {	
 	// Input parameter validation.
 	if(spacing <= 0 ) {
@@ -37,9 +60,46 @@ KMuPkFunctionCPtr distortion, double spacing, int nx, int ny, int nz)
 	if(nx <= 0 || ny <= 0 || nz <= 0) {
 		throw RuntimeError("DistortedPowerCorrelationFft: invalid grid size");
 	}
+	if(symmetric && (nx % 2 || ny % 2)) {
+		throw RuntimeError("DistortedPowerCorrelationFft: symmetric transform requires even nx,ny.");
+	}
+	_nthreads = distorted_power_correlation_fft::getNumThreads(nthreads);
 #ifdef HAVE_LIBFFTW3F
+	_pimpl->data = 0;
+	_pimpl->plane = 0;
 	// Allocate data array.
-	_pimpl->data = (FFTW(complex)*) FFTW(malloc)(sizeof(FFTW(complex)) * nx*ny*nz);
+	if(symmetric) {
+		_pimpl->plane = (float*) FFTW(malloc)(sizeof(float) * (nx/2+1)*(ny/2+1));
+	}
+	else {
+		_pimpl->data = (FFTW(complex)*) FFTW(malloc)(sizeof(FFTW(complex)) * nx*ny*nz);
+	}
+	if(0 == _pimpl->data && 0 == _pimpl->plane) {
+		throw RuntimeError("DistortedPowerCorrelationFft: unable to allocate data array.");
+	}
+	// Create a plan for an in-place transform that will be re-used by each call to transform().
+	// Note that the MeasurePlan strategy overwrites the data array, which is fine here.
+	// A 2D DCT-I of size (n/2+1) along each axis is equivalent to a full FFT of size n
+	// applied to data that is even about zero. The planner is not thread safe and its
+	// thread count is global, so we restore it before releasing the planner lock.
+	int flags = (strategy == MultipoleTransform::EstimatePlan) ? FFTW_ESTIMATE : FFTW_MEASURE;
+	{
+		boost::mutex::scoped_lock lock(getFftwPlannerMutex());
+		setFftwfPlannerThreads(_nthreads);
+		if(symmetric) {
+			_pimpl->plan = FFTW(plan_r2r_2d)(nx/2+1,ny/2+1,_pimpl->plane,_pimpl->plane,
+				FFTW_REDFT00,FFTW_REDFT00,flags);
+		}
+		else {
+			_pimpl->plan = FFTW(plan_dft_3d)(nx,ny,nz,_pimpl->data,_pimpl->data,FFTW_BACKWARD,flags);
+		}
+		setFftwfPlannerThreads(1);
+	}
+	if(0 == _pimpl->plan) {
+		// Our destructor will not run, so release the data array here.
+		FFTW(free)(symmetric ? (void*)_pimpl->plane : (void*)_pimpl->data);
+		throw RuntimeError("DistortedPowerCorrelationFft: unable to create FFTW plan.");
+	}
 #else
     throw RuntimeError("DistortedPowerCorrelationFft: package not built with FFTW3.");
 #endif
@@ -70,10 +130,12 @@ KMuPkFunctionCPtr distortion, double spacing, int nx, int ny, int nz)
 
 local::DistortedPowerCorrelationFft::~DistortedPowerCorrelationFft() {
 #ifdef HAVE_LIBFFTW3F
-    if(0 != _pimpl->data) {
+    {
+        boost::mutex::scoped_lock lock(getFftwPlannerMutex());
         FFTW(destroy_plan)(_pimpl->plan);
-        FFTW(free)(_pimpl->data);
     }
+    if(0 != _pimpl->data) FFTW(free)(_pimpl->data);
+    if(0 != _pimpl->plane) FFTW(free)(_pimpl->plane);
 #endif
 }
 
@@ -96,49 +158,135 @@ double local::DistortedPowerCorrelationFft::getCorrelation(double r, double mu)
 	if(r < 0 || rperp > _spacing*_nx/2 || rpar > _spacing*_ny/2) {
 		throw RuntimeError("DistortedPowerCorrelationFft::getCorrelation: r out of range.");
 	}
+	if(!_bicubicinterpolator) {
+		throw RuntimeError("DistortedPowerCorrelationFft::getCorrelation: no transform available.");
+	}
 	return (*_bicubicinterpolator)(rperp,rpar);
 }
 
+void local::DistortedPowerCorrelationFft::setBatchDistortion(KMuPkBatchFunctionCPtr batch) {
+	_batchDistortion = batch ? batch : createKMuPkBatchFunction(_distortion);
+}
+
 void local::DistortedPowerCorrelationFft::transform() {
 #ifdef HAVE_LIBFFTW3F
-	// Clean up any previous plan.
-    if(_pimpl->data) FFTW(destroy_plan)(_pimpl->plan);
-    // Create a new plan for an in-place transform.
-    _pimpl->plan = FFTW(plan_dft_3d)(_nx,_ny,_nz,_pimpl->data,_pimpl->data,FFTW_BACKWARD,FFTW_ESTIMATE);
-	// Evaluate the power spectrum at each grid point (kx,ky,kz).
-	for(int ix = 0; ix < _nx; ++ix){
-		for(int iy = 0; iy < _ny; ++iy){
-			for(int iz = 0; iz < _nz; ++iz){
-				std::size_t index(iz+_nz*(iy+_ny*ix));
-				double ksq = _kxgrid[ix]*_kxgrid[ix] + _kygrid[iy]*_kygrid[iy] + _kzgrid[iz]*_kzgrid[iz];
-            	double k = std::sqrt(ksq);
-            	if(k==0) {
-            		_pimpl->data[index][0] = 0;
-            		_pimpl->data[index][1] = 0;
-            	}
-            	if(k>0) {
-            		double mu = _kygrid[iy]/k;
-            		_pimpl->data[index][0] = getPower(k,mu);
-            		_pimpl->data[index][1] = 0;
-            	}
-            }
-        }
-    }
-    // Execute FFT to r space.
-	FFTW(execute)(_pimpl->plan);
-	// Extract the correlation function at grid points (rx,ry,0).
-	for(int iy = 0; iy < _ny/2+1; ++iy) {
-        for(int ix = 0; ix < _nx/2+1; ++ix) {
-        	std::size_t ind(_nz*(iy+_ny*ix));
-        	std::size_t ind2(ix+(_nx/2+1)*iy);
-        	_xi[ind2] = (double)_pimpl->data[ind][0]/_norm;
-        }
-    }
+	if(_symmetric) {
+		// Evaluate the power spectrum at each grid point (kx,ky,kz) with kx,ky,kz >= 0
+		// and sum over kz, counting twice each kz that has a negative partner on the grid.
+		// Since we only need xi at rz = 0, this sum replaces the FFT along z.
+		int nxby2(_nx/2), nyby2(_ny/2), nzby2(_nz/2);
+		// Each kx plane of the octant is evaluated with a single call to the batch
+		// distortion function, using buffers private to each thread.
+		int nplane((nyby2+1)*(nzby2+1));
+#ifdef _OPENMP
+		#pragma omp parallel num_threads(_nthreads)
+#endif
+		{
+			std::vector<double> kbuf(nplane), mubuf(nplane), pkbuf(nplane), dbuf(nplane);
+			std::vector<int> ibuf(nplane);
+#ifdef _OPENMP
+			#pragma omp for schedule(static)
+#endif
+			for(int ix = 0; ix <= nxby2; ++ix){
+				int n(0);
+				for(int iy = 0; iy <= nyby2; ++iy){
+					for(int iz = 0; iz <= nzby2; ++iz){
+						double ksq = _kxgrid[ix]*_kxgrid[ix] + _kygrid[iy]*_kygrid[iy] + _kzgrid[iz]*_kzgrid[iz];
+						if(ksq == 0) continue;
+						double k = std::sqrt(ksq);
+						kbuf[n] = k;
+						mubuf[n] = _kygrid[iy]/k;
+						pkbuf[n] = (*_power)(k);
+						ibuf[n] = iz+(nzby2+1)*iy;
+						n++;
+					}
+				}
+				(*_batchDistortion)(n,&kbuf[0],&mubuf[0],&pkbuf[0],&dbuf[0]);
+				for(int iy = 0; iy <= nyby2; ++iy) {
+					_pimpl->plane[iy+(nyby2+1)*ix] = 0;
+				}
+				// Accumulate in double precision before rounding each sum to float.
+				double sum(0);
+				int last(-1);
+				for(int i = 0; i < n; ++i) {
+					int iy(ibuf[i]/(nzby2+1)), iz(ibuf[i]%(nzby2+1));
+					if(iy != last) {
+						if(last >= 0) _pimpl->plane[last+(nyby2+1)*ix] = (float)sum;
+						sum = 0;
+						last = iy;
+					}
+					double wgt = (iz == 0 || 2*iz == _nz) ? 1 : 2;
+					sum += wgt*pkbuf[i]*dbuf[i];
+				}
+				if(last >= 0) _pimpl->plane[last+(nyby2+1)*ix] = (float)sum;
+			}
+		}
+		// Execute the 2D DCT to r space.
+		FFTW(execute)(_pimpl->plan);
+		// Extract the correlation function at grid points (rx,ry,0).
+		for(int iy = 0; iy <= nyby2; ++iy) {
+			for(int ix = 0; ix <= nxby2; ++ix) {
+				_xi[ix+(nxby2+1)*iy] = (double)_pimpl->plane[iy+(nyby2+1)*ix]/_norm;
+			}
+		}
+	}
+	else {
+		// Evaluate the power spectrum at each grid point (kx,ky,kz), distributing the
+		// kx planes over threads. We call our power and distortion functions directly
+		// here, instead of via getPower(), since k and mu are always valid. Each (ky,kz)
+		// plane is evaluated with a single call to the batch distortion function.
+		int nplane(_ny*_nz);
+#ifdef _OPENMP
+		#pragma omp parallel num_threads(_nthreads)
+#endif
+		{
+			std::vector<double> kbuf(nplane), mubuf(nplane), pkbuf(nplane), dbuf(nplane);
+			std::vector<int> ibuf(nplane);
+#ifdef _OPENMP
+			#pragma omp for schedule(static)
+#endif
+			for(int ix = 0; ix < _nx; ++ix){
+				std::size_t offset((std::size_t)nplane*ix);
+				int n(0);
+				for(int iy = 0; iy < _ny; ++iy){
+					for(int iz = 0; iz < _nz; ++iz){
+						std::size_t index(iz+_nz*iy+offset);
+						_pimpl->data[index][0] = 0;
+						_pimpl->data[index][1] = 0;
+						double ksq = _kxgrid[ix]*_kxgrid[ix] + _kygrid[iy]*_kygrid[iy] + _kzgrid[iz]*_kzgrid[iz];
+						if(ksq == 0) continue;
+						double k = std::sqrt(ksq);
+						kbuf[n] = k;
+						mubuf[n] = _kygrid[iy]/k;
+						pkbuf[n] = (*_power)(k);
+						ibuf[n] = iz+_nz*iy;
+						n++;
+					}
+				}
+				(*_batchDistortion)(n,&kbuf[0],&mubuf[0],&pkbuf[0],&dbuf[0]);
+				for(int i = 0; i < n; ++i) {
+					_pimpl->data[ibuf[i]+offset][0] = pkbuf[i]*dbuf[i];
+				}
+			}
+		}
+		// Execute FFT to r space.
+		FFTW(execute)(_pimpl->plan);
+		// Extract the correlation function at grid points (rx,ry,0).
+		for(int iy = 0; iy < _ny/2+1; ++iy) {
+			for(int ix = 0; ix < _nx/2+1; ++ix) {
+				std::size_t ind(_nz*(iy+(std::size_t)_ny*ix));
+				std::size_t ind2(ix+(_nx/2+1)*iy);
+				_xi[ind2] = (double)_pimpl->data[ind][0]/_norm;
+			}
+		}
+	}
     // Create the bicubic interpolator.
-	_bicubicinterpolator = new likely::BiCubicInterpolator(likely::BiCubicInterpolator::DataPlane(_xi),_spacing,_nx/2+1,_ny/2+1);
+	_bicubicinterpolator.reset(new likely::BiCubicInterpolator(
+		likely::BiCubicInterpolator::DataPlane(_xi),_spacing,_nx/2+1,_ny/2+1));
 #endif
 }
 
 std::size_t local::DistortedPowerCorrelationFft::getMemorySize() const {
+    if(_symmetric) return sizeof(*this) + (std::size_t)(_nx/2+1)*(_ny/2+1)*4;
     return sizeof(*this) + (std::size_t)_nx*_ny*_nz*8;
 }
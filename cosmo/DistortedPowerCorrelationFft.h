@@ -4,6 +4,7 @@
 #define COSMO_DISTORTED_POWER_CORRELATION_FFT
 
 #include "cosmo/types.h"
+#include "cosmo/MultipoleTransform.h"
 #include "likely/types.h"
 #include "likely/function.h"
 
@@ -25,18 +26,38 @@ namespace cosmo {
 	//    - transform() each time D(k,mu_k) changes internally
 	//      - call getCorrelation(r,mu) many times
 	//
+	// The FFT plan is created once, by the constructor, and then re-used by each
+	// call to transform().
 	public:
 		// Creates a new distorted power correlation function using the specified
-		// isotropic power P(k) and distortion function D(k,mu).
+		// isotropic power P(k) and distortion function D(k,mu). The strategy selects
+		// a tradeoff between initialization and transform speeds (via the FFTW plan
+		// strategy option). The k-space grid is filled, and the FFT is executed (when
+		// the multithreaded FFTW library is available), using nthreads threads, or all
+		// available threads if nthreads <= 0. The power and distortion functions must
+		// be safe to call concurrently when nthreads is not one. Set symmetric when
+		// D(k,mu) is even in mu, so that P(k,mu) is even in kx, ky and kz, to only
+		// evaluate it in one octant of k space and replace the 3D complex FFT with a
+		// sum over kz and a 2D real DCT. This requires even nx and ny, and uses about
+		// 4*nz times less memory and 8 times fewer evaluations of P(k,mu).
 		DistortedPowerCorrelationFft(likely::GenericFunctionPtr power, KMuPkFunctionCPtr distortion,
-			double spacing, int nx, int ny, int nz);
+			double spacing, int nx, int ny, int nz,
+			MultipoleTransform::Strategy strategy = MultipoleTransform::EstimatePlan,
+			int nthreads = 1, bool symmetric = false);
 		virtual ~DistortedPowerCorrelationFft();
 		// Returns the value of P(k,mu) = P(k)*D(k,mu).
 		double getPower(double k, double mu) const;
-		// Returns the correlation function xi(r,mu).
+		// Returns the correlation function xi(r,mu). Throws a RuntimeError if
+		// transform() has not yet been called.
 		double getCorrelation(double r, double mu) const;
 		// Transforms the k-space power spectrum to r space.
 		void transform();
+		// Sets a batch implementation of our distortion function that transform() will
+		// use to evaluate each kx plane of the k-space grid with a single call. The batch
+		// function must agree with the scalar distortion passed to our constructor, which
+		// is still used by getPower(). Passing an empty pointer restores the default
+		// adapter that calls the scalar function at each point.
+		void setBatchDistortion(KMuPkBatchFunctionCPtr batch);
 		// Returns the memory size in bytes required for this transform or zero if this
         // information is not available.
         virtual std::size_t getMemorySize() const;
@@ -45,11 +66,13 @@ namespace cosmo {
 		boost::scoped_ptr<Implementation> _pimpl;
 		likely::GenericFunctionPtr _power;
 		KMuPkFunctionCPtr _distortion;
+		KMuPkBatchFunctionCPtr _batchDistortion;
 		std::vector<double> _kxgrid, _kygrid, _kzgrid;
 		boost::shared_array<double> _xi;
 		double _spacing, _norm;
-		int _nx, _ny, _nz;
-		likely::BiCubicInterpolator *_bicubicinterpolator;
+		int _nx, _ny, _nz, _nthreads;
+		bool _symmetric;
+		boost::scoped_ptr<likely::BiCubicInterpolator> _bicubicinterpolator;
 	}; // DistortedPowerCorrelationFft
 
 } // cosmo
@@ -1,7 +1,10 @@
 // Created 11-May-2015 by Michael Blomqvist (University of California, Irvine) <cblomqvi@uci.edu>
 
 #include "cosmo/DistortedPowerCorrelationHybrid.h"
+#include "cosmo/KMuPkBatchFunction.h"
 #include "cosmo/RuntimeError.h"
+#include "cosmo/FftwPlanner.h"
+#include "cosmo/TransferFunctionPowerSpectrum.h"
 
 #include "likely/BiCubicInterpolator.h"
 #include "likely/Integrator.h"
@@ -20,6 +23,10 @@
 #define FFTW(X) fftwf_ ## X // prefix identifier (float transform)
 #endif
 
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
 namespace local = cosmo;
 
 namespace cosmo {
@@ -29,12 +36,23 @@ namespace cosmo {
         FFTW(plan) plan;
 #endif
     };
+    namespace distorted_power_correlation_hybrid {
+        // Returns the number of threads to use for a requested value nthreads.
+        int getNumThreads(int nthreads) {
+            if(nthreads > 0) return nthreads;
+#ifdef _OPENMP
+            return omp_get_max_threads();
+#else
+            return 1;
+#endif
+        }
+    }
 }
 
 local::DistortedPowerCorrelationHybrid::DistortedPowerCorrelationHybrid(likely::GenericFunctionPtr power,
 KMuPkFunctionCPtr distortion, double kxmin, double kxmax, int nx, double spacing, int ny, int gridscaling,
-double rmax, double epsAbs, double epsRel)
-: _power(power), _distortion(distortion), _kxmin(0), _kxmax(kxmax), _nx(nx), _spacing(spacing),
+double rmax, double epsAbs, double epsRel, int nthreads)
+: _power(power), _distortion(distortion), _batchDistortion(createKMuPkBatchFunction(distortion)), _kxmin(0), _kxmax(kxmax), _nx(nx), _spacing(spacing),
 _gridscaling(gridscaling), _ny(ny), _rmax(rmax), _epsAbs(epsAbs), _epsRel(epsRel), _pimpl(new Implementation())
 {	
 	// Input parameter validation.
@@ -59,9 +77,29 @@ _gridscaling(gridscaling), _ny(ny), _rmax(rmax), _epsAbs(epsAbs), _epsRel(epsRel
 	if(rmax > ny*spacing/2.) {
 		throw RuntimeError("DistortedPowerCorrelationHybrid: expected rmax < ny*spacing/2");
 	}
+	_nthreads = distorted_power_correlation_hybrid::getNumThreads(nthreads);
 #ifdef HAVE_LIBFFTW3F
-	// Allocate data array for 1D Fourier transform.
-	_pimpl->data = (FFTW(complex)*) FFTW(malloc)(sizeof(FFTW(complex)) * ny);
+	// Allocate a contiguous data array for the nx 1D Fourier transforms along y.
+	_pimpl->data = (FFTW(complex)*) FFTW(malloc)(sizeof(FFTW(complex)) * (std::size_t)nx*ny);
+	if(0 == _pimpl->data) {
+		throw RuntimeError("DistortedPowerCorrelationHybrid: unable to allocate data array.");
+	}
+	// Create a plan for a batch of in-place transforms, one per row, that will be
+	// re-used by each call to ktransform(). The planner is not thread safe and its
+	// thread count is global, so we restore it before releasing the planner lock.
+	int n[1] = { ny };
+	{
+		boost::mutex::scoped_lock lock(getFftwPlannerMutex());
+		setFftwfPlannerThreads(_nthreads);
+		_pimpl->plan = FFTW(plan_many_dft)(1,n,nx,_pimpl->data,0,1,ny,_pimpl->data,0,1,ny,
+			FFTW_BACKWARD,FFTW_ESTIMATE);
+		setFftwfPlannerThreads(1);
+	}
+	if(0 == _pimpl->plan) {
+		// Our destructor will not run, so release the data array here.
+		FFTW(free)(_pimpl->data);
+		throw RuntimeError("DistortedPowerCorrelationHybrid: unable to create FFTW plan.");
+	}
 #else
     throw RuntimeError("DistortedPowerCorrelationHybrid: package not built with FFTW3.");
 #endif
@@ -93,12 +131,48 @@ _gridscaling(gridscaling), _ny(ny), _rmax(rmax), _epsAbs(epsAbs), _epsRel(epsRel
     }
     // Initialize the array that will be used for bicubic interpolation of the correlation function.
     _xi.reset(new double[_nr*_nr]);
+    // Tabulate the weights W(ir,ix) such that the transverse integral
+    //
+    //   xi(rx,ry) = 1/(2pi) Integral[ kx J0(kx*rx) ktf(ry,kx) , {kx,0,kxmax} ]
+    //
+    // at rx = _rgrid[ir] is Sum[ W(ir,ix)*ktf(ry,_kxgrid[ix]) ]. Between grid points,
+    // ktf is approximated by cubic (4-point Lagrange) interpolation and each interval
+    // is integrated with a Gauss-Legendre rule that has enough points to resolve the
+    // oscillations of J0 at the largest rx.
+    int nstencil(std::min(4,nx));
+    int ngauss = 8 + (int)std::ceil(_dkx*_rgrid[_nr-1]);
+    std::vector<double> gaussX, gaussW, lagrange(nstencil);
+    getGaussLegendreRule(ngauss,gaussX,gaussW);
+    _quadrature.assign((std::size_t)_nr*nx,0.);
+    for(int j = 0; j < nx-1; ++j) {
+        // Find the first grid point of the interpolation stencil for this interval.
+        int first = std::max(0,std::min(j-1,nx-nstencil));
+        for(int g = 0; g < ngauss; ++g) {
+            double kx = (j + 0.5*(1+gaussX[g]))*_dkx;
+            double wgt = 0.5*_dkx*gaussW[g]*kx/_twopi;
+            for(int m = 0; m < nstencil; ++m) {
+                double km(_kxgrid[first+m]);
+                lagrange[m] = 1;
+                for(int n = 0; n < nstencil; ++n) {
+                    if(n != m) lagrange[m] *= (kx - _kxgrid[first+n])/(km - _kxgrid[first+n]);
+                }
+            }
+            for(int ir = 0; ir < _nr; ++ir) {
+                double wJ0 = wgt*boost::math::cyl_bessel_j(0,kx*_rgrid[ir]);
+                double *row = &_quadrature[(std::size_t)ir*nx + first];
+                for(int m = 0; m < nstencil; ++m) row[m] += wJ0*lagrange[m];
+            }
+        }
+    }
 }
 
 local::DistortedPowerCorrelationHybrid::~DistortedPowerCorrelationHybrid() {
 #ifdef HAVE_LIBFFTW3F
     if(0 != _pimpl->data) {
-        FFTW(destroy_plan)(_pimpl->plan);
+        {
+            boost::mutex::scoped_lock lock(getFftwPlannerMutex());
+            FFTW(destroy_plan)(_pimpl->plan);
+        }
         FFTW(free)(_pimpl->data);
     }
 #endif
@@ -123,6 +197,9 @@ double local::DistortedPowerCorrelationHybrid::getCorrelation(double r, double m
 	if(r < 0 || rperp > _rmax || rpar > _rmax) {
 		throw RuntimeError("DistortedPowerCorrelationHybrid::getCorrelation: r out of range.");
 	}
+	if(!_xiInterpolator) {
+		throw RuntimeError("DistortedPowerCorrelationHybrid::getCorrelation: no transform available.");
+	}
 	return (*_xiInterpolator)(rperp,rpar);
 }
 
@@ -133,32 +210,46 @@ double local::DistortedPowerCorrelationHybrid::getKTransform(double ry, double k
 	if(ry < 0 || ry > _rmax) {
 		throw RuntimeError("DistortedPowerCorrelationHybrid::getKTransform: expected 0 <= ry <= rmax");
 	}
+	if(!_ktransformInterpolator) {
+		throw RuntimeError("DistortedPowerCorrelationHybrid::getKTransform: no transform available.");
+	}
 	return (*_ktransformInterpolator)(ry,kx);
 }
 
 void local::DistortedPowerCorrelationHybrid::transform() {
     // Perform a series of 1D Fourier transforms.
     ktransform();
-    // Perform a series of 1D integrals.
-    likely::Integrator::IntegrandPtr integrand(new likely::Integrator::Integrand(
-        boost::bind(&DistortedPowerCorrelationHybrid::_transverseIntegrand,this,_1)));
-    likely::Integrator integrator(integrand,_epsAbs,_epsRel);
-    likely::Interpolator::CoordinateValues ktfrow(_nx);
-    for(int iy = 0; iy < _nr; ++iy){
-        for(int i = 0; i < _nx; ++i){
-            std::size_t ind2(iy*_gridscaling+(_ny/2+1)*i);
-            ktfrow[i] = _ktf[ind2];
-        }
-        _ktfInterpolator.reset(new likely::Interpolator(_kxgrid,ktfrow,"cspline"));
-        for(int ix = 0; ix < _nr; ++ix){
-            _rx = _rgrid[ix];
-            std::size_t ind(ix+_nr*iy);
-            _xi[ind] = integrator.integrateRobust(_kxmin,_kxmax)/_twopi;
+    // Perform a series of 1D integrals, as the product of our quadrature weights with
+    // the k-space transform, distributing the ry values over threads. This does not
+    // use any of our mutable state so is safe to run in parallel.
+#ifdef _OPENMP
+    #pragma omp parallel num_threads(_nthreads)
+#endif
+    {
+        std::vector<double> ktfrow(_nx);
+#ifdef _OPENMP
+        #pragma omp for schedule(static)
+#endif
+        for(int iy = 0; iy < _nr; ++iy){
+            for(int i = 0; i < _nx; ++i){
+                std::size_t ind2(iy*_gridscaling+(_ny/2+1)*i);
+                ktfrow[i] = _ktf[ind2];
+            }
+            for(int ix = 0; ix < _nr; ++ix){
+                double const *weights = &_quadrature[(std::size_t)ix*_nx];
+                double sum(0);
+                for(int i = 0; i < _nx; ++i) sum += weights[i]*ktfrow[i];
+                _xi[ix+_nr*iy] = sum;
+            }
         }
     }
     // Create the bicubic interpolator.
-	_xiInterpolator = new likely::BiCubicInterpolator(likely::BiCubicInterpolator::DataPlane(_xi),_spacing*_gridscaling,_nr);
-	
+	_xiInterpolator.reset(new likely::BiCubicInterpolator(
+		likely::BiCubicInterpolator::DataPlane(_xi),_spacing*_gridscaling,_nr));
+}
+
+void local::DistortedPowerCorrelationHybrid::setBatchDistortion(KMuPkBatchFunctionCPtr batch) {
+	_batchDistortion = batch ? batch : createKMuPkBatchFunction(_distortion);
 }
 
 double local::DistortedPowerCorrelationHybrid::_transverseIntegrand(double kx) const {
@@ -167,37 +258,53 @@ double local::DistortedPowerCorrelationHybrid::_transverseIntegrand(double kx) c
 
 void local::DistortedPowerCorrelationHybrid::ktransform() {
 #ifdef HAVE_LIBFFTW3F
+	// Evaluate the power spectrum at each grid point, distributing the kx rows over threads.
+	// We call our power and distortion functions directly here, instead of via getPower(),
+	// since k and mu are always valid. Each row is evaluated with a single call to the
+	// batch distortion function, using buffers private to each thread.
+#ifdef _OPENMP
+	#pragma omp parallel num_threads(_nthreads)
+#endif
+	{
+		std::vector<double> kbuf(_ny), mubuf(_ny), pkbuf(_ny), dbuf(_ny);
+		std::vector<int> ibuf(_ny);
+#ifdef _OPENMP
+		#pragma omp for schedule(static)
+#endif
+		for(int ix = 0; ix < _nx; ++ix){
+			FFTW(complex) *row = _pimpl->data + (std::size_t)_ny*ix;
+			int n(0);
+			for(int iy = 0; iy < _ny; ++iy){
+				row[iy][0] = 0;
+				row[iy][1] = 0;
+				double ksq = _kxgrid[ix]*_kxgrid[ix] + _kygrid[iy]*_kygrid[iy];
+				if(ksq == 0) continue;
+				double k = std::sqrt(ksq);
+				kbuf[n] = k;
+				mubuf[n] = _kygrid[iy]/k;
+				pkbuf[n] = (*_power)(k);
+				ibuf[n] = iy;
+				n++;
+			}
+			(*_batchDistortion)(n,&kbuf[0],&mubuf[0],&pkbuf[0],&dbuf[0]);
+			for(int i = 0; i < n; ++i) {
+				row[ibuf[i]][0] = pkbuf[i]*dbuf[i];
+			}
+		}
+	}
+    // Execute all of the 1D FFTs to r-space.
+    FFTW(execute)(_pimpl->plan);
+    // Extract the transform results for the positive quadrant.
 	for(int ix = 0; ix < _nx; ++ix){
-	    // Clean up any previous plan.
-        if(_pimpl->data) FFTW(destroy_plan)(_pimpl->plan);
-        // Create a new plan for an in-place transform.
-        _pimpl->plan = FFTW(plan_dft_1d)(_ny,_pimpl->data,_pimpl->data,FFTW_BACKWARD,FFTW_ESTIMATE);
-	    // Evaluate the power spectrum at each grid point.
-	    for(int iy = 0; iy < _ny; ++iy){
-		    std::size_t index(iy);
-			double ksq = _kxgrid[ix]*_kxgrid[ix] + _kygrid[iy]*_kygrid[iy];
-            double k = std::sqrt(ksq);
-            if(k==0) {
-            	_pimpl->data[index][0] = 0;
-            	_pimpl->data[index][1] = 0;
-            }
-            if(k>0) {
-            	double mu = _kygrid[iy]/k;
-            	_pimpl->data[index][0] = getPower(k,mu);
-            	_pimpl->data[index][1] = 0;
-            }
-        }
-        // Execute 1D FFT to r-space.
-	    FFTW(execute)(_pimpl->plan);
-	    // Extract the transform result for the positive quadrant.
+	    FFTW(complex) *row = _pimpl->data + (std::size_t)_ny*ix;
 	    for(int iy = 0; iy < _ny/2+1; ++iy) {
-	        std::size_t ind(iy);
 	        std::size_t ind2(iy+(_ny/2+1)*ix);
-	        _ktf[ind2] = (double)_pimpl->data[ind][0]/_norm;
+	        _ktf[ind2] = (double)row[iy][0]/_norm;
 	    }
     }
     // Create the bicubic interpolator.
-	_ktransformInterpolator = new likely::BiCubicInterpolator(likely::BiCubicInterpolator::DataPlane(_ktf),_spacing,_ny/2+1,_nx,_dkx);
+	_ktransformInterpolator.reset(new likely::BiCubicInterpolator(
+		likely::BiCubicInterpolator::DataPlane(_ktf),_spacing,_ny/2+1,_nx,_dkx));
 #endif
 }
 
@@ -223,6 +330,31 @@ double local::DistortedPowerCorrelationHybrid::integrate(double r, double mu) {
     return transIntegrator.integrateRobust(_kxmin,_kxmax)/_twopi;
 }
 
+double local::DistortedPowerCorrelationHybrid::getQuadratureError(int stride) {
+	if(!_xiInterpolator) {
+		throw RuntimeError("DistortedPowerCorrelationHybrid::getQuadratureError: no transform available.");
+	}
+	if(stride <= 0) stride = std::max(1,_nr/8);
+	likely::Integrator::IntegrandPtr integrand(new likely::Integrator::Integrand(
+		boost::bind(&DistortedPowerCorrelationHybrid::_transverseIntegrand,this,_1)));
+	likely::Integrator integrator(integrand,_epsAbs,_epsRel);
+	likely::Interpolator::CoordinateValues ktfrow(_nx);
+	double maxDiff(0), maxValue(0);
+	for(int iy = 0; iy < _nr; iy += stride) {
+		for(int i = 0; i < _nx; ++i) {
+			ktfrow[i] = _ktf[iy*_gridscaling+(_ny/2+1)*i];
+		}
+		_ktfInterpolator.reset(new likely::Interpolator(_kxgrid,ktfrow,"cspline"));
+		for(int ix = 0; ix < _nr; ix += stride) {
+			_rx = _rgrid[ix];
+			double adaptive = integrator.integrateRobust(_kxmin,_kxmax)/_twopi;
+			maxDiff = std::max(maxDiff,std::fabs(_xi[ix+_nr*iy]-adaptive));
+			maxValue = std::max(maxValue,std::fabs(adaptive));
+		}
+	}
+	return maxValue > 0 ? maxDiff/maxValue : maxDiff;
+}
+
 double local::DistortedPowerCorrelationHybrid::_radialIntegrand(double ky) const {
     double ksq = _kx*_kx + ky*ky;
     double k = std::sqrt(ksq);
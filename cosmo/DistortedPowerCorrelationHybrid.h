@@ -28,26 +28,46 @@ namespace cosmo {
 	// The transformation employs a two-step algorithm that first evaluates a series
 	// of 1D Fourier transformations, followed by a series of 1D integrals.
 	// Cartesian x axis represents the transverse direction, and cartesian y axis
-	// represents the radial direction.
+	// represents the radial direction. The 1D integrals use fixed quadrature weights,
+	// tabulated once by the constructor, so that they reduce to a matrix product.
 	public:
 		// Creates a new distorted power correlation function using the specified
-		// isotropic power P(k) and distortion function D(k,mu).
+		// isotropic power P(k) and distortion function D(k,mu). Transforms use nthreads
+		// threads, or all available threads if nthreads <= 0. The epsAbs and epsRel
+		// parameters are the absolute and relative accuracy goals of the adaptive
+		// integrals used by integrate() and getQuadratureError(), and do not affect
+		// transform(), whose accuracy is set by the grid parameters.
 		DistortedPowerCorrelationHybrid(likely::GenericFunctionPtr power, KMuPkFunctionCPtr distortion,
 		    double kxmin, double kxmax, int nx, double spacing, int ny, int gridscaling, double rmax,
-		    double epsAbs = 1e-8, double epsRel = 1e-5);
+		    double epsAbs = 1e-8, double epsRel = 1e-5, int nthreads = 1);
 		virtual ~DistortedPowerCorrelationHybrid();
 		// Returns the value of P(k,mu) = P(k)*D(k,mu).
 		double getPower(double k, double mu) const;
-		// Returns the correlation function xi(r,mu).
+		// Returns the correlation function xi(r,mu). Throws a RuntimeError if
+		// transform() has not yet been called.
 		double getCorrelation(double r, double mu) const;
 		// Returns the k-space transform ktf(ry,kx).
 		double getKTransform(double ry, double kx) const;
 		// Transforms the k-space power spectrum to r-space.
 		void transform();
-		// Performs a series of 1D Fourier transforms of k-space power spectrum.
+		// Performs a series of 1D Fourier transforms of k-space power spectrum, as a single
+		// batch using a plan that is created once by the constructor.
 		void ktransform();
+		// Sets a batch implementation of our distortion function that ktransform() will
+		// use to evaluate each kx row of the k-space grid with a single call. The batch
+		// function must agree with the scalar distortion passed to our constructor, which
+		// is still used by getPower() and integrate(). Passing an empty pointer restores
+		// the default adapter that calls the scalar function at each point.
+		void setBatchDistortion(KMuPkBatchFunctionCPtr batch);
 		// Performs double integral to evaluate xi(rpar,rperp).
 		double integrate(double r, double mu);
+		// Estimates the error of the fixed quadrature used by the last call to transform()
+		// by comparing with adaptive integrals of a cubic spline interpolation of the same
+		// k-space transform, at every stride-th point of our (rx,ry) grid. Uses an automatic
+		// stride that samples about 8 points along each axis when stride <= 0. Returns the
+		// largest absolute difference divided by the largest absolute adaptive value.
+		// Throws a RuntimeError if transform() has not yet been called.
+		double getQuadratureError(int stride = 0);
 		// Returns the memory size in bytes required for this transform or zero if this
         // information is not available.
         virtual std::size_t getMemorySize() const;
@@ -56,13 +76,17 @@ namespace cosmo {
 		boost::scoped_ptr<Implementation> _pimpl;
 		likely::GenericFunctionPtr _power;
 		KMuPkFunctionCPtr _distortion;
+		KMuPkBatchFunctionCPtr _batchDistortion;
 		std::vector<double> _kxgrid, _kygrid, _rgrid;
 		boost::shared_array<double> _ktf, _xi;
 		double _kxmin, _kxmax, _spacing, _rmax, _epsAbs, _epsRel, _twopi, _norm, _rx, _ry, _dkx, _kx;
-		int _nx, _ny, _nr, _gridscaling;
+		int _nx, _ny, _nr, _gridscaling, _nthreads;
+		// Quadrature weights for the transverse integral at each rx, stored as an
+		// _nr x _nx matrix (with kx varying fastest).
+		std::vector<double> _quadrature;
 		double _transverseIntegrand(double kx) const;
 		double _radialIntegrand(double ky) const;
-		likely::BiCubicInterpolator *_xiInterpolator, *_ktransformInterpolator;
+		boost::scoped_ptr<likely::BiCubicInterpolator> _xiInterpolator, _ktransformInterpolator;
 		mutable likely::InterpolatorPtr _ktfInterpolator;
 	}; // DistortedPowerCorrelationHybrid
 
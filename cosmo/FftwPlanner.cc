@@ -0,0 +1,27 @@
+// Created 16-Oct-2026 by agent <agent@local>
+
+#include "cosmo/FftwPlanner.h"
+
+#include "config.h"
+#ifdef HAVE_LIBFFTW3F_THREADS
+#include "fftw3.h"
+#endif
+
+namespace local = cosmo;
+
+boost::mutex &local::getFftwPlannerMutex() {
+	static boost::mutex mutex;
+	return mutex;
+}
+
+void local::setFftwfPlannerThreads(int nthreads) {
+#ifdef HAVE_LIBFFTW3F_THREADS
+	// Only accessed while holding the planner mutex.
+	static bool threadsInitialized(false);
+	if(!threadsInitialized) {
+		fftwf_init_threads();
+		threadsInitialized = true;
+	}
+	fftwf_plan_with_nthreads(nthreads);
+#endif
+}
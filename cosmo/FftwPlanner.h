@@ -0,0 +1,19 @@
+// Created 16-Oct-2026 by agent <agent@local>
+
+#ifndef COSMO_FFTW_PLANNER
+#define COSMO_FFTW_PLANNER
+
+#include <boost/thread/mutex.hpp>
+
+namespace cosmo {
+	// Returns the process-wide mutex that must be held during any call to an FFTW planner
+	// routine, since the planners of all precisions share global state and are not thread safe.
+	boost::mutex &getFftwPlannerMutex();
+	// Sets the number of threads used by subsequent single-precision FFTW plans, initializing
+	// FFTW's thread support the first time it is called. Does nothing unless the package was
+	// built with fftw3f_threads. The caller must hold getFftwPlannerMutex() and should restore
+	// nthreads = 1 before releasing it, so that other plans are not affected.
+	void setFftwfPlannerThreads(int nthreads);
+} // cosmo
+
+#endif // COSMO_FFTW_PLANNER
@@ -1,20 +1,41 @@
 // Created 08-Aug-2011 by David Kirkby (University of California, Irvine) <dkirkby@uci.edu>
 
 #include "cosmo/HomogeneousUniverseCalculator.h"
+#include "cosmo/CubicSpline.h"
+#include "cosmo/TransferFunctionPowerSpectrum.h"
 #include "cosmo/RuntimeError.h"
 
 #include "likely/Integrator.h"
-#include "likely/Interpolator.h"
 
 #include "boost/bind.hpp"
 
 #include <cmath>
+#include <algorithm>
+#include <vector>
+#include <string>
 
 namespace local = cosmo;
 
+namespace cosmo {
+    namespace homogeneous_universe_calculator {
+        // Returns the largest difference between two tables, relative to the largest
+        // absolute value in the reference table.
+        double getMaxRelativeDifference(std::vector<double> const &values,
+        std::vector<double> const &reference) {
+            double maxDiff(0), maxValue(0);
+            for(int i = 0; i < reference.size(); ++i) {
+                maxDiff = std::max(maxDiff,std::fabs(values[i]-reference[i]));
+                maxValue = std::max(maxValue,std::fabs(reference[i]));
+            }
+            return maxValue > 0 ? maxDiff/maxValue : maxDiff;
+        }
+    } // homogeneous_universe_calculator
+} // cosmo
+
 local::HomogeneousUniverseCalculator::HomogeneousUniverseCalculator(double zmax, int nz,
 double epsAbs)
-: _zmax(zmax), _nz(nz), _epsAbs(epsAbs), _curvatureScale(0)
+: _zmax(zmax), _epsAbs(epsAbs), _nz(nz), _tableMethod(AdaptiveIntegration), _order(8),
+_accuracyGuard(0), _curvatureScale(0)
 {
     if(zmax <= 0) {
         throw RuntimeError("HomogeneousUniverseCalculator: invalid zmax <= 0.");
@@ -26,6 +47,27 @@ double epsAbs)
 
 local::HomogeneousUniverseCalculator::~HomogeneousUniverseCalculator() { }
 
+void local::HomogeneousUniverseCalculator::setTableMethod(TableMethod method, int order,
+double accuracyGuard) {
+    if(_lineOfSightSpline || _growthSpline || _lookbackSpline) {
+        throw RuntimeError("HomogeneousUniverseCalculator::setTableMethod: tables already built.");
+    }
+    if(order < 1) {
+        throw RuntimeError("HomogeneousUniverseCalculator::setTableMethod: invalid order < 1.");
+    }
+    if(accuracyGuard < 0) {
+        throw RuntimeError("HomogeneousUniverseCalculator::setTableMethod: invalid accuracyGuard < 0.");
+    }
+    _tableMethod = method;
+    _order = order;
+    _accuracyGuard = accuracyGuard;
+}
+
+void local::HomogeneousUniverseCalculator::getHubbleFunctionValues(int n, double const *z,
+double *result) const {
+    for(int i = 0; i < n; ++i) result[i] = getHubbleFunction(z[i]);
+}
+
 double local::HomogeneousUniverseCalculator::getLineOfSightComovingDistance(double z) const {    
     if(z > _zmax) {
         throw RuntimeError("BasicCosmology::getLineOfSightComovingDistance: z > zmax.");
@@ -33,24 +75,140 @@ double local::HomogeneousUniverseCalculator::getLineOfSightComovingDistance(doub
     if(z < 0) {
         throw RuntimeError("BasicCosmology::getLineOfSightComovingDistance: z < 0.");        
     }
-    if(!_lineOfSightInterpolator) {
-        // Create the interpolator the first time we are called.
-        likely::Integrator::IntegrandPtr integrand(new likely::Integrator::Integrand(
-            boost::bind(&HomogeneousUniverseCalculator::_lineOfSightIntegrand,this,_1)));
-        likely::Integrator integrator(integrand,_epsAbs,0);
-        likely::Interpolator::CoordinateValues zValues(_nz), fValues(_nz);
-        double dz = _zmax/(_nz-1);
-        zValues[0] = 0;
-        fValues[0] = 0;
-        zValues[1] = dz;
-        fValues[1] = integrator.integrateSmooth(0,dz);
-        for(int i = 2; i < _nz; ++i) {
-            zValues[i] = i*dz;
-            fValues[i] = fValues[i-1] + integrator.integrateSmooth((i-1)*dz,i*dz);
+    _initLineOfSight();
+    return (*_lineOfSightSpline)(z);
+}
+
+void local::HomogeneousUniverseCalculator::_initLineOfSight() const {
+    if(_lineOfSightSpline) return;
+    // Create the interpolator the first time we are called.
+    if(_tableMethod == FixedStepQuadrature) {
+        _createFixedStepTables();
+    }
+    else {
+        std::vector<double> fValues;
+        _tabulateLineOfSight(fValues);
+        _lineOfSightSpline.reset(new CubicSpline(_getZValues()));
+        _lineOfSightSpline->fit(fValues);
+    }
+}
+
+void local::HomogeneousUniverseCalculator::_checkRedshifts(int n, double const *z,
+char const *method) const {
+    for(int i = 0; i < n; ++i) {
+        if(z[i] > _zmax) {
+            throw RuntimeError(std::string("HomogeneousUniverseCalculator::") + method + ": z > zmax.");
+        }
+        if(z[i] < 0) {
+            throw RuntimeError(std::string("HomogeneousUniverseCalculator::") + method + ": z < 0.");
+        }
+    }
+}
+
+void local::HomogeneousUniverseCalculator::getLineOfSightComovingDistances(int n, double const *z,
+double *result) const {
+    _checkRedshifts(n,z,"getLineOfSightComovingDistances");
+    _initLineOfSight();
+    _lineOfSightSpline->evaluate(n,z,result);
+}
+
+void local::HomogeneousUniverseCalculator::getDistances(int n, double const *z, double *lineOfSight,
+double *transverse, double *angularDiameter, double *luminosity, double *hubble) const {
+    getLineOfSightComovingDistances(n,z,lineOfSight);
+    if(transverse || angularDiameter || luminosity) {
+        // Correct the line of sight scale for any curvature.
+        double OmegaK(getCurvature()), scale(hubbleLength()/std::sqrt(std::fabs(OmegaK)));
+        for(int i = 0; i < n; ++i) {
+            double dm(lineOfSight[i]);
+            if(OmegaK > 0) dm = scale*std::sinh(dm/scale);
+            else if(OmegaK < 0) dm = scale*std::sin(dm/scale);
+            if(transverse) transverse[i] = dm;
+            if(angularDiameter) angularDiameter[i] = dm/(1+z[i]);
+            if(luminosity) luminosity[i] = dm*(1+z[i]);
+        }
+    }
+    if(hubble) getHubbleFunctionValues(n,z,hubble);
+}
+
+std::vector<double> local::HomogeneousUniverseCalculator::_getZValues() const {
+    std::vector<double> zValues(_nz);
+    double dz = _zmax/(_nz-1);
+    for(int i = 0; i < _nz; ++i) zValues[i] = i*dz;
+    return zValues;
+}
+
+void local::HomogeneousUniverseCalculator::_tabulateLineOfSight(std::vector<double> &fValues) const {
+    likely::Integrator::IntegrandPtr integrand(new likely::Integrator::Integrand(
+        boost::bind(&HomogeneousUniverseCalculator::_lineOfSightIntegrand,this,_1)));
+    likely::Integrator integrator(integrand,_epsAbs,0);
+    fValues.resize(_nz);
+    double dz = _zmax/(_nz-1);
+    fValues[0] = 0;
+    fValues[1] = integrator.integrateSmooth(0,dz);
+    for(int i = 2; i < _nz; ++i) {
+        fValues[i] = fValues[i-1] + integrator.integrateSmooth((i-1)*dz,i*dz);
+    }
+}
+
+double local::HomogeneousUniverseCalculator::getRedshiftAtComovingDistance(double distance) const {
+    _initInverseLineOfSight();
+    if(distance < 0) {
+        throw RuntimeError("HomogeneousUniverseCalculator::getRedshiftAtComovingDistance: distance < 0.");
+    }
+    if(distance > _inverseLineOfSightSpline->getX().back()) {
+        throw RuntimeError("HomogeneousUniverseCalculator::getRedshiftAtComovingDistance: distance > D(zmax).");
+    }
+    return (*_inverseLineOfSightSpline)(distance);
+}
+
+void local::HomogeneousUniverseCalculator::getRedshiftsAtComovingDistances(int n,
+double const *distance, double *result) const {
+    _initInverseLineOfSight();
+    double dmax(_inverseLineOfSightSpline->getX().back());
+    for(int i = 0; i < n; ++i) {
+        if(distance[i] < 0) {
+            throw RuntimeError("HomogeneousUniverseCalculator::getRedshiftsAtComovingDistances: distance < 0.");
+        }
+        if(distance[i] > dmax) {
+            throw RuntimeError("HomogeneousUniverseCalculator::getRedshiftsAtComovingDistances: distance > D(zmax).");
         }
-        _lineOfSightInterpolator.reset(new likely::Interpolator(zValues,fValues,"cspline"));
     }
-    return (*_lineOfSightInterpolator)(z);
+    _inverseLineOfSightSpline->evaluate(n,distance,result);
+}
+
+void local::HomogeneousUniverseCalculator::_initInverseLineOfSight() const {
+    if(_inverseLineOfSightSpline) return;
+    _initLineOfSight();
+    // The forward table D(z) is strictly increasing since H(z) > 0.
+    std::vector<double> const &zValues = _lineOfSightSpline->getX();
+    std::vector<double> const &dValues = _lineOfSightSpline->getY();
+    double dmax(dValues.back()), dd(dmax/(_nz-1));
+    std::vector<double> distance(_nz), redshift(_nz);
+    redshift[0] = 0;
+    int cell(0);
+    for(int j = 1; j < _nz; ++j) {
+        double target = j*dd;
+        distance[j] = target;
+        if(j == _nz-1) {
+            redshift[j] = _zmax;
+            break;
+        }
+        // Find the forward table cell containing this distance, starting from the
+        // previous cell since our targets are increasing.
+        while(cell < _nz-2 && dValues[cell+1] < target) ++cell;
+        double zlo(zValues[cell]), zhi(zValues[cell+1]);
+        // Start from a linear interpolation within the cell, then refine with Newton's
+        // method using dD/dz = c/H(z), staying within the cell.
+        double z = zlo + (zhi-zlo)*(target-dValues[cell])/(dValues[cell+1]-dValues[cell]);
+        for(int iter = 0; iter < 4; ++iter) {
+            z -= ((*_lineOfSightSpline)(z) - target)*getHubbleFunction(z)/hubbleLength();
+            if(z < zlo) z = zlo;
+            else if(z > zhi) z = zhi;
+        }
+        redshift[j] = z;
+    }
+    _inverseLineOfSightSpline.reset(new CubicSpline(distance));
+    _inverseLineOfSightSpline->fit(redshift);
 }
 
 double local::HomogeneousUniverseCalculator::_lineOfSightIntegrand(double z) const {
@@ -82,26 +240,35 @@ double local::HomogeneousUniverseCalculator::getGrowthFunction(double z) const {
     if(z < 0) {
         throw RuntimeError("BasicCosmology::getGrowthFunction: z < 0.");        
     }
-    if(!_growthInterpolator) {
+    if(!_growthSpline) {
         // Create the interpolator the first time we are called.
-        likely::Integrator::IntegrandPtr integrand(new likely::Integrator::Integrand(
-            boost::bind(&HomogeneousUniverseCalculator::_growthIntegrand,this,_1)));
-        likely::Integrator integrator(integrand,_epsAbs,0);
-        likely::Interpolator::CoordinateValues zValues(_nz), fValues(_nz);
-        double dz = _zmax/(_nz-1);
-        zValues[_nz-1] = _zmax;
-        fValues[_nz-1] = integrator.integrateUp(_zmax);
-        for(int i = _nz-2; i >= 0; --i) {
-            double z(i*dz);
-            zValues[i] = z;
-            fValues[i] = fValues[i+1] + integrator.integrateSmooth(z,(i+1)*dz);
+        if(_tableMethod == FixedStepQuadrature) {
+            _createFixedStepTables();
         }
-        for(int i = 0; i < _nz; ++i) {
-            fValues[i] *= getHubbleFunction(i*dz);
+        else {
+            std::vector<double> fValues;
+            _tabulateGrowth(fValues);
+            _growthSpline.reset(new CubicSpline(_getZValues()));
+            _growthSpline->fit(fValues);
         }
-        _growthInterpolator.reset(new likely::Interpolator(zValues,fValues,"cspline"));
     }
-    return (*_growthInterpolator)(z);
+    return (*_growthSpline)(z);
+}
+
+void local::HomogeneousUniverseCalculator::_tabulateGrowth(std::vector<double> &fValues) const {
+    likely::Integrator::IntegrandPtr integrand(new likely::Integrator::Integrand(
+        boost::bind(&HomogeneousUniverseCalculator::_growthIntegrand,this,_1)));
+    likely::Integrator integrator(integrand,_epsAbs,0);
+    fValues.resize(_nz);
+    double dz = _zmax/(_nz-1);
+    fValues[_nz-1] = integrator.integrateUp(_zmax);
+    for(int i = _nz-2; i >= 0; --i) {
+        double z(i*dz);
+        fValues[i] = fValues[i+1] + integrator.integrateSmooth(z,(i+1)*dz);
+    }
+    for(int i = 0; i < _nz; ++i) {
+        fValues[i] *= getHubbleFunction(i*dz);
+    }
 }
 
 double local::HomogeneousUniverseCalculator::_growthIntegrand(double z) const {
@@ -116,26 +283,119 @@ double local::HomogeneousUniverseCalculator::getLookbackTime(double z) const {
     if(z < 0) {
         throw RuntimeError("BasicCosmology::getLookbackTime: z < 0.");        
     }
-    if(!_lookbackInterpolator) {
+    if(!_lookbackSpline) {
         // Create the interpolator the first time we are called.
-        likely::Integrator::IntegrandPtr integrand(new likely::Integrator::Integrand(
-            boost::bind(&HomogeneousUniverseCalculator::_lookbackIntegrand,this,_1)));
-        likely::Integrator integrator(integrand,_epsAbs,1e-8); // needs epsRel > 0
-        likely::Interpolator::CoordinateValues zValues(_nz), fValues(_nz);
-        double dz = _zmax/(_nz-1);
-        zValues[0] = 0;
-        fValues[0] = 0;
-        zValues[1] = dz;
-        fValues[1] = integrator.integrateSmooth(0,dz);
-        for(int i = 2; i < _nz; ++i) {
-            zValues[i] = i*dz;
-            fValues[i] = fValues[i-1] + integrator.integrateSmooth((i-1)*dz,i*dz);
+        if(_tableMethod == FixedStepQuadrature) {
+            _createFixedStepTables();
+        }
+        else {
+            std::vector<double> fValues;
+            _tabulateLookback(fValues);
+            _lookbackSpline.reset(new CubicSpline(_getZValues()));
+            _lookbackSpline->fit(fValues);
         }
-        _lookbackInterpolator.reset(new likely::Interpolator(zValues,fValues,"cspline"));
     }
-    return (*_lookbackInterpolator)(z);    
+    return (*_lookbackSpline)(z);    
+}
+
+void local::HomogeneousUniverseCalculator::_tabulateLookback(std::vector<double> &fValues) const {
+    likely::Integrator::IntegrandPtr integrand(new likely::Integrator::Integrand(
+        boost::bind(&HomogeneousUniverseCalculator::_lookbackIntegrand,this,_1)));
+    likely::Integrator integrator(integrand,_epsAbs,1e-8); // needs epsRel > 0
+    fValues.resize(_nz);
+    double dz = _zmax/(_nz-1);
+    fValues[0] = 0;
+    fValues[1] = integrator.integrateSmooth(0,dz);
+    for(int i = 2; i < _nz; ++i) {
+        fValues[i] = fValues[i-1] + integrator.integrateSmooth((i-1)*dz,i*dz);
+    }
 }
 
 double local::HomogeneousUniverseCalculator::_lookbackIntegrand(double z) const {
     return hubbleTime()/(1+z)/getHubbleFunction(z);
 }
+
+void local::HomogeneousUniverseCalculator::_createFixedStepTables() const {
+    // Use the same Gauss-Legendre rule in each of the nz-1 grid cells, and in each of
+    // ntail panels covering zmax < z < infinity for the growth function. The tail is
+    // integrated in t = 1/sqrt(1+z), where
+    //
+    //   Integral[(1+z)/H(z)^3,{z,zmax,infinity}] = Integral[2/(t^5 H^3),{t,0,tmax}]
+    //
+    // has a smooth integrand that vanishes at t = 0 when matter or radiation dominates.
+    std::vector<double> x, w;
+    getGaussLegendreRule(_order,x,w);
+    int ncells(_nz-1), ntail(8);
+    double dz = _zmax/ncells, tmax = 1/std::sqrt(1+_zmax), dt = tmax/ntail;
+    // Build the list of all redshifts where we need H(z): the cell nodes, then the
+    // tail nodes, then the grid points, so that it is evaluated with a single call.
+    int ncellNodes(ncells*_order), ntailNodes(ntail*_order);
+    std::vector<double> z(ncellNodes+ntailNodes+_nz), hz(z.size());
+    for(int c = 0; c < ncells; ++c) {
+        for(int j = 0; j < _order; ++j) {
+            z[c*_order+j] = (c + 0.5*(1+x[j]))*dz;
+        }
+    }
+    for(int p = 0; p < ntail; ++p) {
+        for(int j = 0; j < _order; ++j) {
+            double t = (p + 0.5*(1+x[j]))*dt;
+            z[ncellNodes+p*_order+j] = 1/(t*t) - 1;
+        }
+    }
+    for(int i = 0; i < _nz; ++i) {
+        z[ncellNodes+ntailNodes+i] = i*dz;
+    }
+    getHubbleFunctionValues(z.size(),&z[0],&hz[0]);
+    // Integrate all three tables in one pass over the cells.
+    std::vector<double> lineOfSight(_nz), lookback(_nz), growth(_nz);
+    double losScale(0.5*dz*hubbleLength()), lookbackScale(0.5*dz*hubbleTime());
+    lineOfSight[0] = lookback[0] = 0;
+    for(int c = 0; c < ncells; ++c) {
+        double losSum(0), lookbackSum(0), growthSum(0);
+        for(int j = 0; j < _order; ++j) {
+            int index(c*_order+j);
+            double hinv(1/hz[index]), zp1(1+z[index]);
+            losSum += w[j]*hinv;
+            lookbackSum += w[j]*hinv/zp1;
+            growthSum += w[j]*zp1*hinv*hinv*hinv;
+        }
+        lineOfSight[c+1] = lineOfSight[c] + losScale*losSum;
+        lookback[c+1] = lookback[c] + lookbackScale*lookbackSum;
+        // Save each cell's growth integral for now, and accumulate it from above below.
+        growth[c] = 0.5*dz*growthSum;
+    }
+    double tailSum(0);
+    for(int p = 0; p < ntail; ++p) {
+        for(int j = 0; j < _order; ++j) {
+            int index(ncellNodes+p*_order+j);
+            double t = (p + 0.5*(1+x[j]))*dt, hinv(1/hz[index]);
+            tailSum += w[j]*2*hinv*hinv*hinv/(t*t*t*t*t);
+        }
+    }
+    growth[ncells] = 0.5*dt*tailSum;
+    for(int i = ncells-1; i >= 0; --i) growth[i] += growth[i+1];
+    for(int i = 0; i < _nz; ++i) growth[i] *= hz[ncellNodes+ntailNodes+i];
+    // Compare with the adaptive tables, if requested.
+    if(_accuracyGuard > 0) {
+        std::vector<double> reference;
+        _tabulateLineOfSight(reference);
+        if(homogeneous_universe_calculator::getMaxRelativeDifference(lineOfSight,reference) > _accuracyGuard) {
+            throw RuntimeError("HomogeneousUniverseCalculator: line-of-sight table fails accuracy guard.");
+        }
+        _tabulateLookback(reference);
+        if(homogeneous_universe_calculator::getMaxRelativeDifference(lookback,reference) > _accuracyGuard) {
+            throw RuntimeError("HomogeneousUniverseCalculator: lookback table fails accuracy guard.");
+        }
+        _tabulateGrowth(reference);
+        if(homogeneous_universe_calculator::getMaxRelativeDifference(growth,reference) > _accuracyGuard) {
+            throw RuntimeError("HomogeneousUniverseCalculator: growth table fails accuracy guard.");
+        }
+    }
+    std::vector<double> zValues(_getZValues());
+    _lineOfSightSpline.reset(new CubicSpline(zValues));
+    _lineOfSightSpline->fit(lineOfSight);
+    _lookbackSpline.reset(new CubicSpline(zValues));
+    _lookbackSpline->fit(lookback);
+    _growthSpline.reset(new CubicSpline(zValues));
+    _growthSpline->fit(growth);
+}
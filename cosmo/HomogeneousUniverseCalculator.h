@@ -5,8 +5,13 @@
 
 #include "cosmo/AbsHomogeneousUniverse.h"
 
+#include "cosmo/types.h"
 #include "likely/types.h"
 
+#include "boost/smart_ptr.hpp"
+
+#include <vector>
+
 namespace cosmo {
     // Calculates the properties of a homogeneous and isotropic universe numerically
     // based on its Hubble function H(z)/H(0) and present-day curvature 1 - Omega(0).
@@ -18,11 +23,26 @@ namespace cosmo {
 	    // Uses the specified target absolute accuracy for the interpolated points.
 		HomogeneousUniverseCalculator(double zmax, int nz, double epsAbs);
 		virtual ~HomogeneousUniverseCalculator();
+		// Interpolation tables are built either by adaptive numerical integration over
+		// each grid cell, using epsAbs, or with a fixed-step Gauss-Legendre rule in each
+		// cell that builds all tables together in one pass from a single call to
+		// getHubbleFunctionValues().
+		enum TableMethod { AdaptiveIntegration, FixedStepQuadrature };
+		// Selects the method used to build our interpolation tables, which must be called
+		// before any table is needed. The fixed-step method uses a Gauss-Legendre rule of
+		// the specified order in each cell. If accuracyGuard > 0, then each fixed-step table
+		// is also compared with the adaptive method, and a RuntimeError is thrown if their
+		// largest difference, relative to the largest tabulated value, exceeds accuracyGuard.
+		void setTableMethod(TableMethod method, int order = 8, double accuracyGuard = 0);
 		// Returns the present-day curvature defined as 1 - Omega(0).
         virtual double getCurvature() const = 0;
 		// Returns the normalized Hubble function value H(z)/H(0) at the specified
 		// redshift z >= 0.
         virtual double getHubbleFunction(double z) const = 0;
+        // Evaluates the normalized Hubble function at n redshifts z[i] >= 0 and saves the
+        // results in result[i]. The default implementation calls getHubbleFunction(z)
+        // for each redshift, but subclasses can provide a faster version.
+        virtual void getHubbleFunctionValues(int n, double const *z, double *result) const;
         // Returns the comoving line of sight distance in Mpc/h to an emitter with
         // the specified redshift z >= 0.
         virtual double getLineOfSightComovingDistance(double z) const;
@@ -30,6 +50,23 @@ namespace cosmo {
         // emitters at the same specified redshift z >= 0. Multiply this value by
         // the observed separation angle (rad) to obtain a physical distance in Mpc/h.
         virtual double getTransverseComovingScale(double z) const;
+        // Calculates comoving line of sight distances for n redshifts in [0,zmax] at once.
+        // The range of all redshifts is checked first, then each distance is interpolated
+        // without any virtual function calls, using the uniform spacing of our z grid to
+        // locate each interval directly.
+        virtual void getLineOfSightComovingDistances(int n, double const *z, double *result) const;
+        // Calculates the distances and Hubble function described in AbsHomogeneousUniverse
+        // for n redshifts in [0,zmax] at once, using the fast methods above.
+        virtual void getDistances(int n, double const *z, double *lineOfSight,
+            double *transverse = 0, double *angularDiameter = 0, double *luminosity = 0,
+            double *hubble = 0) const;
+        // Returns the redshift z in [0,zmax] of an emitter at the specified comoving line of
+        // sight distance in Mpc/h, which must lie in [0,D(zmax)]. This inverts
+        // getLineOfSightComovingDistance() using a table that is built on first use, with
+        // the same number of points as our z grid, uniformly spaced in distance.
+        double getRedshiftAtComovingDistance(double distance) const;
+        // Calculates the redshifts for n comoving line of sight distances at once.
+        void getRedshiftsAtComovingDistances(int n, double const *distance, double *result) const;
         // Returns the lookback time for an emitter at the specified redshift, defined as
         // the difference between the ages of the universe now and when a photon at
         // cosmological redshift z was emitted. Units are secs/h.
@@ -42,12 +79,25 @@ namespace cosmo {
 	private:
         double _zmax, _epsAbs;
         int _nz;
+        TableMethod _tableMethod;
+        int _order;
+        double _accuracyGuard;
         mutable double _curvatureScale;
-        mutable likely::InterpolatorPtr _lineOfSightInterpolator, _growthInterpolator,
-            _lookbackInterpolator;
+        // Natural cubic splines on our uniform z grid, created on first use.
+        mutable boost::scoped_ptr<CubicSpline> _lineOfSightSpline, _growthSpline, _lookbackSpline;
+        // Natural cubic spline of z on a uniform grid of line of sight distances.
+        mutable boost::scoped_ptr<CubicSpline> _inverseLineOfSightSpline;
         double _lineOfSightIntegrand(double z) const;
         double _growthIntegrand(double z) const;
         double _lookbackIntegrand(double z) const;
+        std::vector<double> _getZValues() const;
+        void _checkRedshifts(int n, double const *z, char const *method) const;
+        void _initLineOfSight() const;
+        void _initInverseLineOfSight() const;
+        void _tabulateLineOfSight(std::vector<double> &fValues) const;
+        void _tabulateGrowth(std::vector<double> &fValues) const;
+        void _tabulateLookback(std::vector<double> &fValues) const;
+        void _createFixedStepTables() const;
 	}; // HomogeneousUniverseCalculator
 } // cosmo
 
@@ -0,0 +1,30 @@
+// Created 16-Oct-2026 by agent <agent@local>
+
+#include "cosmo/KMuPkBatchFunction.h"
+#include "cosmo/RuntimeError.h"
+
+#include "boost/bind.hpp"
+
+namespace local = cosmo;
+
+namespace cosmo {
+	namespace kmupk_batch_function {
+		// Evaluates a scalar function at each of n points.
+		void evaluateScalar(KMuPkFunctionCPtr scalar, int n, double const *k, double const *mu,
+		double const *Pk, double *result) {
+			KMuPkFunction const &fn(*scalar);
+			for(int i = 0; i < n; ++i) {
+				result[i] = fn(k[i],mu[i],Pk[i]);
+			}
+		}
+	} // kmupk_batch_function
+} // cosmo
+
+local::KMuPkBatchFunctionCPtr local::createKMuPkBatchFunction(KMuPkFunctionCPtr scalar) {
+	if(!scalar) {
+		throw RuntimeError("createKMuPkBatchFunction: expected a scalar function.");
+	}
+	KMuPkBatchFunctionCPtr batch(new KMuPkBatchFunction(boost::bind(
+		&kmupk_batch_function::evaluateScalar,scalar,_1,_2,_3,_4,_5)));
+	return batch;
+}
@@ -0,0 +1,17 @@
+// Created 16-Oct-2026 by agent <agent@local>
+
+#ifndef COSMO_KMUPK_BATCH_FUNCTION
+#define COSMO_KMUPK_BATCH_FUNCTION
+
+#include "cosmo/types.h"
+
+namespace cosmo {
+
+	// Returns a batch function that evaluates the scalar function provided at each
+	// point in turn. Use this adapter for distortion models that do not provide their
+	// own batch implementation.
+	KMuPkBatchFunctionCPtr createKMuPkBatchFunction(KMuPkFunctionCPtr scalar);
+
+} // cosmo
+
+#endif // COSMO_KMUPK_BATCH_FUNCTION
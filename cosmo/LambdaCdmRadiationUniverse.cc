@@ -44,3 +44,15 @@ double local::LambdaCdmRadiationUniverse::getHubbleFunction(double z) const {
     double ainv(1+z);
     return std::sqrt(_OmegaLambda + ainv*ainv*(_OmegaK + ainv*(_OmegaMatter + ainv*_OmegaRadiation)));
 }
+
+void local::LambdaCdmRadiationUniverse::getHubbleFunctionValues(int n, double const *z, double *result) const {
+    for(int i = 0; i < n; ++i) {
+        if(z[i] < 0) {
+            throw RuntimeError("LambdaCdmRadiationUniverse::getHubbleFunctionValues: z < 0.");
+        }
+    }
+    for(int i = 0; i < n; ++i) {
+        double ainv(1+z[i]);
+        result[i] = std::sqrt(_OmegaLambda + ainv*ainv*(_OmegaK + ainv*(_OmegaMatter + ainv*_OmegaRadiation)));
+    }
+}
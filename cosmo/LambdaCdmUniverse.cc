@@ -34,3 +34,15 @@ double local::LambdaCdmUniverse::getHubbleFunction(double z) const {
     double ainv(1+z);
     return std::sqrt(_OmegaLambda + ainv*ainv*(_curvature + ainv*_OmegaMatter));
 }
+
+void local::LambdaCdmUniverse::getHubbleFunctionValues(int n, double const *z, double *result) const {
+    for(int i = 0; i < n; ++i) {
+        if(z[i] < 0) {
+            throw RuntimeError("LambdaCdmUniverse::getHubbleFunctionValues: z < 0.");
+        }
+    }
+    for(int i = 0; i < n; ++i) {
+        double ainv(1+z[i]);
+        result[i] = std::sqrt(_OmegaLambda + ainv*ainv*(_curvature + ainv*_OmegaMatter));
+    }
+}
@@ -16,6 +16,9 @@ namespace cosmo {
 		// Returns the normalized Hubble function value H(z)/H(0) at the specified
 		// redshift z >= 0.
         virtual double getHubbleFunction(double z) const;
+        // Evaluates the normalized Hubble function at n redshifts z[i] >= 0, without any
+        // per-point virtual function calls.
+        virtual void getHubbleFunctionValues(int n, double const *z, double *result) const;
 	private:
         double _OmegaLambda, _OmegaMatter, _curvature;
 	}; // LambdaCdmUniverse
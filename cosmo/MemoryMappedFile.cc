@@ -0,0 +1,43 @@
+// Created 16-Oct-2026 by agent <agent@local>
+
+#include "cosmo/MemoryMappedFile.h"
+#include "cosmo/RuntimeError.h"
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace local = cosmo;
+
+local::MemoryMappedFile::MemoryMappedFile(std::string const &filename)
+: _data(0), _size(0)
+{
+	int fd = ::open(filename.c_str(),O_RDONLY);
+	if(fd < 0) {
+		throw RuntimeError("MemoryMappedFile: unable to open " + filename + ".");
+	}
+	struct stat info;
+	if(::fstat(fd,&info) != 0) {
+		::close(fd);
+		throw RuntimeError("MemoryMappedFile: unable to stat " + filename + ".");
+	}
+	_size = (std::size_t)info.st_size;
+	if(_size > 0) {
+		void *addr = ::mmap(0,_size,PROT_READ,MAP_PRIVATE,fd,0);
+		if(addr == MAP_FAILED) {
+			::close(fd);
+			throw RuntimeError("MemoryMappedFile: unable to map " + filename + ".");
+		}
+		// We normally scan the file from start to end, so ask for aggressive read-ahead.
+		::madvise(addr,_size,MADV_SEQUENTIAL);
+		_data = static_cast<char const*>(addr);
+	}
+	// The mapping remains valid after the descriptor is closed.
+	::close(fd);
+}
+
+local::MemoryMappedFile::~MemoryMappedFile() {
+	if(_data) ::munmap(const_cast<char*>(_data),_size);
+}
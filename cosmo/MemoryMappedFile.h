@@ -0,0 +1,36 @@
+// Created 16-Oct-2026 by agent <agent@local>
+
+#ifndef COSMO_MEMORY_MAPPED_FILE
+#define COSMO_MEMORY_MAPPED_FILE
+
+#include <string>
+#include <cstddef>
+
+namespace cosmo {
+	class MemoryMappedFile {
+	// Provides read-only access to the contents of a file that is mapped into our
+	// address space, so that it can be scanned in place (and in parallel) without
+	// copying it through an input stream. The mapping is released on destruction.
+	public:
+		// Maps the named file, or throws a RuntimeError if this is not possible.
+		// An empty file is valid and has a null data pointer.
+		explicit MemoryMappedFile(std::string const &filename);
+		virtual ~MemoryMappedFile();
+		// Returns a pointer to the first byte of the mapped file.
+		char const *getData() const;
+		// Returns the size of the mapped file in bytes.
+		std::size_t getSize() const;
+	private:
+		// Mappings cannot be copied.
+		MemoryMappedFile(MemoryMappedFile const &other);
+		MemoryMappedFile &operator=(MemoryMappedFile const &other);
+		char const *_data;
+		std::size_t _size;
+	}; // MemoryMappedFile
+
+	inline char const *MemoryMappedFile::getData() const { return _data; }
+	inline std::size_t MemoryMappedFile::getSize() const { return _size; }
+
+} // cosmo
+
+#endif // COSMO_MEMORY_MAPPED_FILE
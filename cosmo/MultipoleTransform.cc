@@ -2,41 +2,508 @@
 
 #include "cosmo/MultipoleTransform.h"
 #include "cosmo/RuntimeError.h"
+#include "cosmo/FftwPlanner.h"
 
 #include "config.h"
 #ifdef HAVE_LIBFFTW3
 #include "fftw3.h"
-#define FFTW(X) fftw_ ## X // double transforms
-typedef double FftwReal;
-//#define FFTW(X) fftwf_ ## X // float transforms
-//typedef float FftwReal;
-//#define FFTW(X) fftwl_ ## X // long double transforms
-//typedef long double FftwReal;
 #endif
 
 #include <boost/math/special_functions/gamma.hpp>
 #include <boost/math/special_functions/bessel.hpp>
 
+#include <boost/cstdint.hpp>
+#include <boost/thread/mutex.hpp>
+
 #include <cmath>
 #include <cstdlib> // for abs(int)
+#include <cstdio> // for rename, remove
+#include <cstring>
 #include <vector>
+#include <map>
+#include <algorithm>
+#include <string>
+#include <sstream>
+#include <fstream>
+#include <iterator>
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
 
 namespace local = cosmo;
 
 namespace cosmo {
+    namespace multipole_transform {
+#ifdef HAVE_LIBFFTW3
+        // Wraps the FFTW functions that we use for each supported floating-point
+        // precision R, so that the code below can be written once as templates.
+        // Precision identifies R without relying on sizeof(R), since long double
+        // has the same size as double on some platforms.
+        template <class R> struct Fftw;
+#define COSMO_MULTIPOLE_TRANSFORM_FFTW(R,X,P) \
+        template <> struct Fftw<R> { \
+            static MultipoleTransform::Precision precision() { return MultipoleTransform::P; } \
+            typedef X ## _complex Complex; \
+            typedef X ## _plan Plan; \
+            static void *malloc(std::size_t n) { return X ## _malloc(n); } \
+            static void free(void *p) { X ## _free(p); } \
+            static Plan planR2C(int n, int howmany, R *in, Complex *out, unsigned flags) { \
+                return X ## _plan_many_dft_r2c(1,&n,howmany,in,0,1,2*(n/2+1),out,0,1,n/2+1,flags); \
+            } \
+            static Plan planC2R(int n, int howmany, Complex *in, R *out, unsigned flags) { \
+                return X ## _plan_many_dft_c2r(1,&n,howmany,in,0,1,n/2+1,out,0,1,2*(n/2+1),flags); \
+            } \
+            static void execute(Plan p) { X ## _execute(p); } \
+            static void executeR2C(Plan p, R *in, Complex *out) { X ## _execute_dft_r2c(p,in,out); } \
+            static void executeC2R(Plan p, Complex *in, R *out) { X ## _execute_dft_c2r(p,in,out); } \
+            static void destroy(Plan p) { X ## _destroy_plan(p); } \
+            static char *exportWisdom() { return X ## _export_wisdom_to_string(); } \
+            static int importWisdom(char const *wisdom) { return X ## _import_wisdom_from_string(wisdom); } \
+        };
+        COSMO_MULTIPOLE_TRANSFORM_FFTW(double,fftw,DoublePrecision)
+#ifdef HAVE_LIBFFTW3F
+        COSMO_MULTIPOLE_TRANSFORM_FFTW(float,fftwf,SinglePrecision)
+#endif
+#ifdef HAVE_LIBFFTW3L
+        COSMO_MULTIPOLE_TRANSFORM_FFTW(long double,fftwl,ExtendedPrecision)
+#endif
+#undef COSMO_MULTIPOLE_TRANSFORM_FFTW
+        // Returns the process-wide mutex that serializes access to the kernel registry
+        // and cache directory and all calls to the FFTW planner, which is not thread safe.
+        // This is a real lock, rather than an OpenMP critical section, so that it also
+        // works in builds without OpenMP and with threads created by the application.
+        // It is the same lock used by the other classes that create FFTW plans.
+        boost::mutex &getKernelMutex() {
+            return getFftwPlannerMutex();
+        }
+        // Base class for kernels of any precision.
+        struct AbsKernel {
+            virtual ~AbsKernel() { }
+        };
+        typedef boost::shared_ptr<const AbsKernel> KernelCPtr;
+        // Holds the Fourier transform of a tabulated kernel S'(s) and the plans used to
+        // convolve with it, which are shared by all transforms with the same kernel key.
+        // Since the kernel is real, we only store the Ntot+1 non-negative frequencies of
+        // its 2*Ntot point transform, and these include the 1/(2*Ntot) normalization of
+        // the inverse transform.
+        // The kernel values are either allocated with FFTW's allocator or else point
+        // into a memory-mapped kernel cache file.
+        template <class R> struct Kernel : public AbsKernel {
+            typedef typename Fftw<R>::Complex Complex;
+            typedef typename Fftw<R>::Plan Plan;
+            struct BatchPlans {
+                Plan forward,backward;
+            };
+            typedef std::map<int,BatchPlans> BatchPlansMap;
+            Kernel() : fdata(0), gplan(0), fgplan(0), mapped(0), mappedSize(0) { }
+            virtual ~Kernel() {
+                // The FFTW planner (which also destroys plans) is not thread safe. Kernels
+                // without plans can be destroyed while the kernel mutex is held, but the
+                // last reference to a kernel with plans must never be released while
+                // holding it, since the mutex is not recursive.
+                if(0 != gplan) {
+                    {
+                        boost::mutex::scoped_lock lock(getKernelMutex());
+                        Fftw<R>::destroy(gplan);
+                        Fftw<R>::destroy(fgplan);
+                        for(typename BatchPlansMap::iterator iter = batchPlans.begin();
+                        iter != batchPlans.end(); ++iter) {
+                            Fftw<R>::destroy(iter->second.forward);
+                            Fftw<R>::destroy(iter->second.backward);
+                        }
+                    }
+                }
+#ifdef HAVE_SYS_MMAN_H
+                if(0 != mapped) {
+                    ::munmap(mapped,mappedSize);
+                    return;
+                }
+#endif
+                if(0 != fdata) Fftw<R>::free(fdata);
+            }
+            int Ntot, flags;
+            Complex *fdata;
+            Plan gplan,fgplan;
+            // Plans for batch transforms, indexed by the number of functions, which must
+            // only be accessed while holding the kernel mutex.
+            mutable BatchPlansMap batchPlans;
+            void *mapped;
+            std::size_t mappedSize;
+        };
+        // Identifies kernels that are numerically identical. The plan strategy is
+        // included since it can change results at the level of roundoff errors.
+        struct KernelKey {
+            KernelKey(int type_, int ell_, int Nf_, int Ntot_, double ds_, int strategy_,
+            int precision_) : type(type_), ell(ell_), Nf(Nf_), Ntot(Ntot_), ds(ds_),
+            strategy(strategy_), precision(precision_) { }
+            bool operator<(KernelKey const &other) const {
+                if(type != other.type) return type < other.type;
+                if(ell != other.ell) return ell < other.ell;
+                if(Nf != other.Nf) return Nf < other.Nf;
+                if(Ntot != other.Ntot) return Ntot < other.Ntot;
+                if(ds != other.ds) return ds < other.ds;
+                if(strategy != other.strategy) return strategy < other.strategy;
+                return precision < other.precision;
+            }
+            int type, ell, Nf, Ntot;
+            double ds;
+            int strategy, precision;
+        };
+        typedef std::map<KernelKey,KernelCPtr> KernelRegistry;
+        // Returns the process-wide kernel registry, which must only be accessed
+        // while holding the kernel mutex.
+        KernelRegistry &getKernelRegistry() {
+            static KernelRegistry registry;
+            return registry;
+        }
+        // Returns the directory used for kernel cache files, which is empty when the
+        // on-disk cache is disabled. Must only be accessed while holding the kernel mutex.
+        std::string &getKernelCacheDirectory() {
+            static std::string directory;
+            return directory;
+        }
+        // Kernel cache files consist of this fixed-size header, followed by the Ntot+1
+        // complex kernel values, followed by wisdomSize bytes of FFTW wisdom. The header
+        // size is a multiple of 16 bytes so that kernel values are SIMD aligned in a
+        // memory-mapped file. Increment the version after any change to this layout
+        // or to the kernel calculation.
+        struct KernelFileHeader {
+            char magic[8];
+            boost::uint32_t version, byteOrder;
+            boost::int32_t precision, type, ell, Nf, Ntot, strategy;
+            double ds;
+            boost::int64_t wisdomSize, reserved;
+        };
+        char const *kernelFileMagic = "cosmoMTK";
+        boost::uint32_t const kernelFileVersion = 3, kernelFileByteOrder = 0x01020304;
+        // Returns the name of the cache file for the specified kernel.
+        std::string getKernelFileName(std::string const &directory, KernelKey const &key) {
+            boost::uint64_t dsBits;
+            std::memcpy(&dsBits,&key.ds,sizeof(dsBits));
+            std::ostringstream name;
+            name << directory << "/multipole-" << key.precision << '-' << key.type << '-'
+                << key.ell << '-' << key.Nf << '-' << key.Ntot << '-' << key.strategy << '-'
+                << std::hex << dsBits << ".kernel";
+            return name.str();
+        }
+        // Fills the header for the specified kernel.
+        void fillKernelFileHeader(KernelFileHeader &header, KernelKey const &key,
+        std::size_t wisdomSize) {
+            std::memset(&header,0,sizeof(header));
+            std::memcpy(header.magic,kernelFileMagic,sizeof(header.magic));
+            header.version = kernelFileVersion;
+            header.byteOrder = kernelFileByteOrder;
+            header.precision = key.precision;
+            header.type = key.type;
+            header.ell = key.ell;
+            header.Nf = key.Nf;
+            header.Ntot = key.Ntot;
+            header.strategy = key.strategy;
+            header.ds = key.ds;
+            header.wisdomSize = wisdomSize;
+        }
+        // Creates the real-to-complex and complex-to-real plans for convolving with a
+        // kernel, using a temporary buffer of Ntot+1 complex values whose first 2*Ntot
+        // reals hold the real-space data. The plans do in-place transforms and are later
+        // executed on the (identically aligned) buffer of whatever workspace is passed
+        // to transform().
+        template <class R> void planKernel(Kernel<R> &kernel, int Ntot,
+        MultipoleTransform::Strategy strategy) {
+            typedef typename Fftw<R>::Complex Complex;
+            Complex *gdata = (Complex*)Fftw<R>::malloc(sizeof(Complex)*(Ntot+1));
+            int flags = (strategy == MultipoleTransform::EstimatePlan) ?
+                FFTW_ESTIMATE : FFTW_MEASURE;
+            kernel.Ntot = Ntot;
+            kernel.flags = flags;
+            kernel.gplan = Fftw<R>::planR2C(2*Ntot,1,(R*)gdata,gdata,flags);
+            kernel.fgplan = Fftw<R>::planC2R(2*Ntot,1,gdata,(R*)gdata,flags);
+            Fftw<R>::free(gdata);
+        }
+        // Returns the plans for transforming nfunc functions at once, creating them if
+        // necessary. The plans transform in place, with each function's data starting
+        // on a new block of Ntot+1 complex values.
+        template <class R> typename Kernel<R>::BatchPlans getBatchPlans(Kernel<R> const &kernel,
+        int nfunc) {
+            typedef typename Fftw<R>::Complex Complex;
+            typename Kernel<R>::BatchPlans plans;
+            if(nfunc == 1) {
+                plans.forward = kernel.gplan;
+                plans.backward = kernel.fgplan;
+                return plans;
+            }
+            {
+                boost::mutex::scoped_lock lock(getKernelMutex());
+                typename Kernel<R>::BatchPlansMap::const_iterator
+                    found = kernel.batchPlans.find(nfunc);
+                if(found != kernel.batchPlans.end()) {
+                    plans = found->second;
+                }
+                else {
+                    int n(2*kernel.Ntot), nhalf(kernel.Ntot+1);
+                    Complex *gdata = (Complex*)Fftw<R>::malloc(sizeof(Complex)*nhalf*nfunc);
+                    plans.forward = Fftw<R>::planR2C(n,nfunc,(R*)gdata,gdata,kernel.flags);
+                    plans.backward = Fftw<R>::planC2R(n,nfunc,gdata,(R*)gdata,kernel.flags);
+                    Fftw<R>::free(gdata);
+                    kernel.batchPlans.insert(std::make_pair(nfunc,plans));
+                }
+            }
+            return plans;
+        }
+        // Multiplies the n complex values in gdata by the corresponding kernel values.
+        template <class R> void multiplyKernel(R const (*fdata)[2], R (*gdata)[2], int n) {
+            for(int m = 0; m < n; ++m) {
+                R re1 = fdata[m][0], im1 = fdata[m][1];
+                R re2 = gdata[m][0], im2 = gdata[m][1];
+                gdata[m][0] = re1*re2 - im1*im2;
+                gdata[m][1] = re1*im2 + re2*im1;
+            }
+        }
+        // Tabulates f(s) of eqn (1.4) or (2.2) and calculates its Fourier transform.
+        // This is called while holding the kernel mutex, so the tabulation (where the
+        // Bessel functions can throw) is done before creating any plans: a partially
+        // built kernel that still has plans would deadlock in its destructor.
+        template <class R> KernelCPtr buildKernel(MultipoleTransform::Type type, int ell,
+        int Nf, int Ntot, double ds, double uv0, double alpha,
+        MultipoleTransform::Strategy strategy) {
+            typedef typename Fftw<R>::Complex Complex;
+            std::vector<R> ftable(2*Ntot);
+            for(int m = 0; m < 2*Ntot; ++m) {
+                long double xarg;
+                int n = m;
+                if(n >= Ntot) n -= 2*Ntot;
+                if(std::abs(n) > Nf) {
+                    ftable[m] = 0.;
+                }
+                else {
+                    long double bessel,s = n*ds;
+                    xarg = uv0*std::exp(s);
+                    if(type == MultipoleTransform::SphericalBessel) {
+                        bessel = boost::math::sph_bessel(ell,xarg);
+                    }
+                    else {
+                        bessel = boost::math::cyl_bessel_j(ell,xarg);
+                    }
+                    ftable[m] = (R)(std::exp(alpha*s)*bessel*ds);
+                }
+            }
+            boost::shared_ptr<Kernel<R> > kernel(new Kernel<R>());
+            Complex *fdata = (Complex*)Fftw<R>::malloc(sizeof(Complex)*(Ntot+1));
+            R *freal = (R*)fdata;
+            kernel->fdata = fdata;
+            int flags = (strategy == MultipoleTransform::EstimatePlan) ?
+                FFTW_ESTIMATE : FFTW_MEASURE;
+            // Planning with FFTW_MEASURE overwrites fdata, so we only copy the tabulated
+            // values in afterwards.
+            typename Fftw<R>::Plan fplan = Fftw<R>::planR2C(2*Ntot,1,freal,fdata,flags);
+            planKernel(*kernel,Ntot,strategy);
+            std::copy(ftable.begin(),ftable.end(),freal);
+            // Calculate the Fourier transform of fdata and fold in the normalization
+            // of the inverse transform.
+            Fftw<R>::execute(fplan);
+            Fftw<R>::destroy(fplan);
+            R norm(2*Ntot);
+            for(int m = 0; m <= Ntot; ++m) {
+                fdata[m][0] /= norm;
+                fdata[m][1] /= norm;
+            }
+            return kernel;
+        }
+        // Loads the specified kernel from its cache file, if possible, and returns an empty
+        // pointer if the file is missing or does not match the key. Any wisdom saved in the
+        // file is imported before planning, so that MeasurePlan planning is fast.
+        template <class R> KernelCPtr loadKernel(std::string const &filename,
+        KernelKey const &key, MultipoleTransform::Strategy strategy) {
+            typedef typename Fftw<R>::Complex Complex;
+            KernelCPtr result;
+            boost::shared_ptr<Kernel<R> > kernel(new Kernel<R>());
+            std::size_t dataSize = sizeof(Complex)*(key.Ntot+1), fileSize;
+            char const *contents;
+#ifdef HAVE_SYS_MMAN_H
+            int fd = ::open(filename.c_str(),O_RDONLY);
+            if(fd < 0) return result;
+            struct stat info;
+            if(0 != ::fstat(fd,&info) || info.st_size < sizeof(KernelFileHeader)) {
+                ::close(fd);
+                return result;
+            }
+            fileSize = info.st_size;
+            void *mapped = ::mmap(0,fileSize,PROT_READ,MAP_SHARED,fd,0);
+            // The mapping remains valid after the file is closed.
+            ::close(fd);
+            if(MAP_FAILED == mapped) return result;
+            kernel->mapped = mapped;
+            kernel->mappedSize = fileSize;
+            contents = (char const*)mapped;
+#else
+            std::ifstream in(filename.c_str(),std::ios::binary);
+            if(!in.good()) return result;
+            std::vector<char> buffer((std::istreambuf_iterator<char>(in)),
+                std::istreambuf_iterator<char>());
+            fileSize = buffer.size();
+            if(fileSize < sizeof(KernelFileHeader)) return result;
+            contents = &buffer[0];
+#endif
+            KernelFileHeader header, expected;
+            std::memcpy(&header,contents,sizeof(header));
+            fillKernelFileHeader(expected,key,header.wisdomSize);
+            if(0 != std::memcmp(&header,&expected,sizeof(header)) || header.wisdomSize < 0 ||
+                fileSize != sizeof(header) + dataSize + header.wisdomSize) return result;
+#ifdef HAVE_SYS_MMAN_H
+            kernel->fdata = (Complex*)(contents + sizeof(header));
+#else
+            kernel->fdata = (Complex*)Fftw<R>::malloc(dataSize);
+            std::memcpy(kernel->fdata,contents + sizeof(header),dataSize);
+#endif
+            if(header.wisdomSize > 0) {
+                std::string wisdom(contents + sizeof(header) + dataSize,header.wisdomSize);
+                Fftw<R>::importWisdom(wisdom.c_str());
+            }
+            planKernel(*kernel,key.Ntot,strategy);
+            result = kernel;
+            return result;
+        }
+        // Saves the specified kernel to its cache file. The file is written under a
+        // temporary name and then renamed so that concurrent processes never read a
+        // partially written file. Failures are silently ignored since the cache is only
+        // an optimization.
+        template <class R> void saveKernel(std::string const &filename, KernelKey const &key,
+        KernelCPtr kernel) {
+            typedef typename Fftw<R>::Complex Complex;
+            std::string wisdom;
+            if(key.strategy == MultipoleTransform::MeasurePlan) {
+                char *exported = Fftw<R>::exportWisdom();
+                if(0 != exported) {
+                    wisdom = exported;
+                    std::free(exported);
+                }
+            }
+            KernelFileHeader header;
+            fillKernelFileHeader(header,key,wisdom.size());
+            std::ostringstream tmpname;
+            tmpname << filename << ".tmp";
+#ifdef HAVE_UNISTD_H
+            tmpname << ::getpid();
+#endif
+            std::ofstream out(tmpname.str().c_str(),std::ios::binary);
+            out.write((char const*)&header,sizeof(header));
+            out.write((char const*)static_cast<Kernel<R> const&>(*kernel).fdata,
+                sizeof(Complex)*(key.Ntot+1));
+            out.write(wisdom.data(),wisdom.size());
+            out.close();
+            if(!out.good() || 0 != std::rename(tmpname.str().c_str(),filename.c_str())) {
+                std::remove(tmpname.str().c_str());
+            }
+        }
+        // Returns the kernel for the specified key from the process-wide registry, or else
+        // from the on-disk cache, or else builds a new kernel. Building while holding the
+        // kernel mutex also serializes calls to the FFTW planner. The result is declared
+        // outside the locked scope so that it is only released after unlocking if
+        // anything below throws.
+        template <class R> KernelCPtr findKernel(KernelKey const &key, double uv0, double alpha) {
+            KernelCPtr kernel;
+            MultipoleTransform::Strategy strategy = (MultipoleTransform::Strategy)key.strategy;
+            {
+                boost::mutex::scoped_lock lock(getKernelMutex());
+                KernelRegistry &registry = getKernelRegistry();
+                KernelRegistry::iterator found = registry.find(key);
+                if(found != registry.end()) {
+                    kernel = found->second;
+                }
+                else {
+                    // Try the on-disk cache before building a new kernel.
+                    std::string const &directory = getKernelCacheDirectory();
+                    std::string filename;
+                    if(!directory.empty()) {
+                        filename = getKernelFileName(directory,key);
+                        kernel = loadKernel<R>(filename,key,strategy);
+                    }
+                    if(!kernel) {
+                        kernel = buildKernel<R>((MultipoleTransform::Type)key.type,key.ell,
+                            key.Nf,key.Ntot,key.ds,uv0,alpha,strategy);
+                        if(!directory.empty()) saveKernel<R>(filename,key,kernel);
+                    }
+                    registry.insert(std::make_pair(key,kernel));
+                }
+            }
+            return kernel;
+        }
+#endif
+        // Calculates the parameters alpha and uv0 of eqn (1.6) or (2.4) and s0 of
+        // eqn (1.8) or (2.6) for the specified transform type and multipole.
+        void getKernelParameters(MultipoleTransform::Type type, int ell,
+        double &alpha, double &uv0, double &s0) {
+            double pi(atan2(0,-1));
+            if(type == MultipoleTransform::SphericalBessel) {
+                alpha = 0.5*(1-ell);
+                double gammaEll32 = boost::math::tgamma(ell+1.5);
+                uv0 = 2*std::pow(gammaEll32/std::sqrt(pi),1./(ell+1));
+                s0 = 2./(ell+1);
+            }
+            else {
+                alpha = 0.25*(1-2*ell);
+                double gammaEll1 = boost::math::tgamma(ell+1);
+                uv0 = 2*std::pow(gammaEll1/std::sqrt(pi),1./(ell+0.5));
+                s0 = 4./(2*ell+1);
+            }
+        }
+    } // multipole_transform
     struct MultipoleTransform::Implementation {
 #ifdef HAVE_LIBFFTW3
-        FFTW(complex) *fdata,*gdata;
-        FFTW(plan) fplan,gplan,fgplan;
+        multipole_transform::KernelCPtr kernel;
+#endif
+    };
+    struct MultipoleTransform::Workspace::Implementation {
+        Implementation() : data(0), size(0), precision(MultipoleTransform::DoublePrecision) { }
+        ~Implementation() { release(); }
+        // Ensures that our buffer has room for at least n complex values of precision R.
+        // Any previous contents are lost when the buffer grows.
+        template <class R> void *reserve(int n) {
+#ifdef HAVE_LIBFFTW3
+            std::size_t bytes = 2*sizeof(R)*n;
+            if(bytes <= size && precision == multipole_transform::Fftw<R>::precision()) return data;
+            release();
+            data = multipole_transform::Fftw<R>::malloc(bytes);
+            size = bytes;
+            precision = multipole_transform::Fftw<R>::precision();
+#endif
+            return data;
+        }
+        // Frees our buffer using the allocator of the precision that created it.
+        void release() {
+#ifdef HAVE_LIBFFTW3
+            if(0 == data) return;
+            if(precision == MultipoleTransform::DoublePrecision) multipole_transform::Fftw<double>::free(data);
+#ifdef HAVE_LIBFFTW3F
+            else if(precision == MultipoleTransform::SinglePrecision) multipole_transform::Fftw<float>::free(data);
+#endif
+#ifdef HAVE_LIBFFTW3L
+            else if(precision == MultipoleTransform::ExtendedPrecision) multipole_transform::Fftw<long double>::free(data);
+#endif
+            data = 0;
+            size = 0;
 #endif
+        }
+        void *data;
+        std::size_t size;
+        MultipoleTransform::Precision precision;
     };
 } // cosmo::
 
+local::MultipoleTransform::Workspace::Workspace() : _pimpl(new Implementation()) { }
+
+local::MultipoleTransform::Workspace::~Workspace() { }
+
 local::MultipoleTransform::MultipoleTransform(Type type, int ell,
 double vmin, double vmax, double veps, Strategy strategy,
-int minSamplesPerCycle, int minSamplesPerDecade, int interpolationPadding) :
-_type(type),_minSamplesPerCycle(minSamplesPerCycle),
-_pimpl(new Implementation())
+int minSamplesPerCycle, int minSamplesPerDecade, int interpolationPadding, Precision precision) :
+_type(type),_minSamplesPerCycle(minSamplesPerCycle),_precision(precision),
+_pimpl(new Implementation()), _workspace(new Workspace())
 {
 #ifndef HAVE_LIBFFTW3
 	throw RuntimeError("MultipoleTransform: library not built with fftw3f support.");
@@ -63,24 +530,13 @@ _pimpl(new Implementation())
 	if(minSamplesPerDecade < 0) {
 		throw RuntimeError("MultipoleTransform: expected minSamplesPerDecade >= 0.");
 	}
+	if(_precision != SinglePrecision && _precision != DoublePrecision &&
+	_precision != ExtendedPrecision) {
+		throw RuntimeError("MultipoleTransform: invalid precision.");
+	}
 	double pi(atan2(0,-1));
 	double alpha, uv0, s0;
-	if(_type == SphericalBessel) {
-		// Calculate alpha and uv0 of eqn (1.6)
-		alpha = 0.5*(1-ell);
-		double gammaEll32 = boost::math::tgamma(ell+1.5);
-		uv0 = 2*std::pow(gammaEll32/std::sqrt(pi),1./(ell+1));
-		// Calculate s0 of eqn (1.8)
-		s0 = 2./(ell+1);
-	}
-	else {
-		// Calculate alpha and uv0 of eqn (2.4)
-		alpha = 0.25*(1-2*ell);
-		double gammaEll1 = boost::math::tgamma(ell+1);
-		uv0 = 2*std::pow(gammaEll1/std::sqrt(pi),1./(ell+0.5));
-		// Calculate s0 of eqn (2.6)
-		s0 = 4./(2*ell+1);
-	}
+	multipole_transform::getKernelParameters(_type,ell,alpha,uv0,s0);
 	// Calculate c of eqn (3.4)
 	double arg, c = 2*pi/minSamplesPerCycle/uv0;
 	if(veps > 0) {
@@ -121,48 +577,61 @@ _pimpl(new Implementation())
 	double ds = sN/_Nf;
 	// Calculate the geometric mean of the target v range of eqn (3.9)
 	double v0 = std::sqrt(vmin*vmax);
-	// Calculate the corresponding u0 and its powers
-	double u0 = uv0/v0;
-	double u02 = u0*u0, u03 = u0*u02;
 	// Calculate Ng of eqn (3.1)
 	int Ng = (int)std::ceil(std::log(vmax/vmin)/(2*ds)+interpolationPadding);
+	_initialize(ell,Ng,ds,v0,strategy);
+}
+
+local::MultipoleTransform::MultipoleTransform(MultipoleTransform const &finer, Strategy strategy) :
+_type(finer._type),_ell(finer._ell),_eps(finer._eps),_minSamplesPerCycle(finer._minSamplesPerCycle),
+_precision(finer._precision),_pimpl(new Implementation()), _workspace(new Workspace())
+{
+	// Use half as many kernel samples with twice the spacing, so that the kernel covers
+	// (at least) the same range of s, and the largest u grid that fits inside the finer grid.
+	_Nf = (finer._Nf+1)/2;
+	int Ng = finer._ugrid.size()/4 - _Nf;
+	if(Ng <= 0) {
+		throw RuntimeError("MultipoleTransform: finer transform has too few points to subsample.");
+	}
+	_initialize(_ell,Ng,2*finer._ds,finer._v0,strategy);
+}
+
+void local::MultipoleTransform::_initialize(int ell, int Ng, double ds, double v0,
+Strategy strategy) {
+	_ell = ell;
+	_ds = ds;
+	_v0 = v0;
+	double alpha, uv0, s0;
+	multipole_transform::getKernelParameters(_type,ell,alpha,uv0,s0);
+	// Calculate the u0 corresponding to v0 and its powers
+	double u0 = uv0/v0;
+	double u02 = u0*u0, u03 = u0*u02;
 	// Tabulate f(s) of eqn (1.4) or (2.2)
 	int Ntot = _Nf + Ng;
 #ifdef HAVE_LIBFFTW3
-	// Allocate SIMD aligned arrays using FFTW's allocator
-	_pimpl->fdata = (FFTW(complex)*)FFTW(malloc)(sizeof(FFTW(complex))*2*Ntot);
-	_pimpl->gdata = (FFTW(complex)*)FFTW(malloc)(sizeof(FFTW(complex))*2*Ntot);
-	// Build plans for doing transforms in place. FFTW is supposed to be smart
-	// about re-using plans with the same dimensions but different arrays.
-	int flags = (strategy == EstimatePlan) ? FFTW_ESTIMATE : FFTW_MEASURE;
-	_pimpl->fplan = FFTW(plan_dft_1d)(2*Ntot,_pimpl->fdata,_pimpl->fdata,
-		FFTW_FORWARD,flags);
-	_pimpl->gplan = FFTW(plan_dft_1d)(2*Ntot,_pimpl->gdata,_pimpl->gdata,
-		FFTW_FORWARD,flags);
-	_pimpl->fgplan = FFTW(plan_dft_1d)(2*Ntot,_pimpl->gdata,_pimpl->gdata,
-		FFTW_BACKWARD,flags);
-	for(int m = 0; m < 2*Ntot; ++m) {
-		long double xarg;
-		int n = m;
-		if(n >= Ntot) n -= 2*Ntot;
-		if(std::abs(n) > _Nf) {
-			_pimpl->fdata[m][0] = _pimpl->fdata[m][1] = 0.;
-		}
-		else {
-			long double bessel,s = n*ds;
-			xarg = uv0*std::exp(s);
-			if(_type == SphericalBessel) {
-				bessel = boost::math::sph_bessel(ell,xarg);
-			}
-			else {
-				bessel = boost::math::cyl_bessel_j(ell,xarg);
-			}
-			_pimpl->fdata[m][0] = std::exp(alpha*s)*bessel*ds;
-			_pimpl->fdata[m][1] = 0.;
-		}
+	// Look up our kernel in the process-wide registry, or build and register it now.
+	switch(_precision) {
+	case SinglePrecision:
+#ifdef HAVE_LIBFFTW3F
+		_pimpl->kernel = multipole_transform::findKernel<float>(multipole_transform::KernelKey(
+			_type,ell,_Nf,Ntot,ds,strategy,_precision),uv0,alpha);
+		break;
+#else
+		throw RuntimeError("MultipoleTransform: library not built with fftw3f support.");
+#endif
+	case DoublePrecision:
+		_pimpl->kernel = multipole_transform::findKernel<double>(multipole_transform::KernelKey(
+			_type,ell,_Nf,Ntot,ds,strategy,_precision),uv0,alpha);
+		break;
+	case ExtendedPrecision:
+#ifdef HAVE_LIBFFTW3L
+		_pimpl->kernel = multipole_transform::findKernel<long double>(multipole_transform::KernelKey(
+			_type,ell,_Nf,Ntot,ds,strategy,_precision),uv0,alpha);
+		break;
+#else
+		throw RuntimeError("MultipoleTransform: library not built with fftw3l support.");
+#endif
 	}
-	// Calculate the Fourier transform of fdata
-	FFTW(execute)(_pimpl->fplan);
 #endif
 	// Tabulate the u values where func(u) should be evaluated, the
 	// coefficients needed to rescale func(u(s)) to g(s), the v values
@@ -189,44 +658,148 @@ _pimpl(new Implementation())
 	}
 }
 
-local::MultipoleTransform::~MultipoleTransform() {
+local::MultipoleTransform::~MultipoleTransform() { }
+
+void local::MultipoleTransform::clearKernelCache() {
 #ifdef HAVE_LIBFFTW3
-    FFTW(destroy_plan)(_pimpl->fplan);
-    FFTW(destroy_plan)(_pimpl->gplan);
-    FFTW(destroy_plan)(_pimpl->fgplan);
-    FFTW(free)(_pimpl->fdata);
-    FFTW(free)(_pimpl->gdata);
+	multipole_transform::KernelRegistry released;
+	{
+		boost::mutex::scoped_lock lock(multipole_transform::getKernelMutex());
+		released.swap(multipole_transform::getKernelRegistry());
+	}
+	// Any kernels that are no longer in use are destroyed when released goes out of
+	// scope, which must happen after the kernel mutex is released above.
+#endif
+}
+
+void local::MultipoleTransform::setKernelCacheDirectory(std::string const &path) {
+#ifdef HAVE_LIBFFTW3
+	{
+		boost::mutex::scoped_lock lock(multipole_transform::getKernelMutex());
+		multipole_transform::getKernelCacheDirectory() = path;
+	}
+#endif
+}
+
+std::string local::MultipoleTransform::getKernelCacheDirectory() {
+	std::string path;
+#ifdef HAVE_LIBFFTW3
+	{
+		boost::mutex::scoped_lock lock(multipole_transform::getKernelMutex());
+		path = multipole_transform::getKernelCacheDirectory();
+	}
+#endif
+	return path;
+}
+
+int local::MultipoleTransform::getKernelCacheSize() {
+	int size(0);
+#ifdef HAVE_LIBFFTW3
+	{
+		boost::mutex::scoped_lock lock(multipole_transform::getKernelMutex());
+		size = multipole_transform::getKernelRegistry().size();
+	}
 #endif
+	return size;
 }
 
 void local::MultipoleTransform::transform(std::vector<double> const &funcTable,
 std::vector<double> &result) const {
+	transform(funcTable,result,*_workspace);
+}
+
+void local::MultipoleTransform::transform(std::vector<double> const &funcTable,
+std::vector<double> &result, Workspace &workspace) const {
+	// Resize the result vector if necessary, which only allocates memory when its
+	// capacity needs to grow.
+	int nv(_vgrid.size());
+	result.resize(nv);
+	_dispatch(&funcTable[0],1,&result[0],workspace);
+}
+
+void local::MultipoleTransform::transformBatch(std::vector<double> const &funcTables, int nfunc,
+std::vector<double> &results) const {
+	transformBatch(funcTables,nfunc,results,*_workspace);
+}
+
+void local::MultipoleTransform::transformBatch(std::vector<double> const &funcTables, int nfunc,
+std::vector<double> &results, Workspace &workspace) const {
+	int nu(_ugrid.size()), nv(_vgrid.size());
+	if(nfunc <= 0) {
+		throw RuntimeError("MultipoleTransform::transformBatch: expected nfunc > 0.");
+	}
+	if(funcTables.size() != nfunc*nu) {
+		throw RuntimeError("MultipoleTransform::transformBatch: funcTables has the wrong size.");
+	}
+	// Resize the results vector if necessary, which only allocates memory when its
+	// capacity needs to grow.
+	results.resize(nfunc*nv);
+	_dispatch(&funcTables[0],nfunc,&results[0],workspace);
+}
+
+void local::MultipoleTransform::_dispatch(double const *funcTables, int nfunc, double *results,
+Workspace &workspace) const {
 #ifndef HAVE_LIBFFTW3
 	throw RuntimeError("MultipoleTransform: library not built with fftw3 support.");
 #else
+	switch(_precision) {
+#ifdef HAVE_LIBFFTW3F
+	case SinglePrecision:
+		_transform<float>(funcTables,nfunc,results,workspace);
+		break;
+#endif
+	case DoublePrecision:
+		_transform<double>(funcTables,nfunc,results,workspace);
+		break;
+#ifdef HAVE_LIBFFTW3L
+	case ExtendedPrecision:
+		_transform<long double>(funcTables,nfunc,results,workspace);
+		break;
+#endif
+	default:
+		// The constructor has already rejected precisions that we were not built with.
+		break;
+	}
+#endif
+}
+
+template <class R> void local::MultipoleTransform::_transform(double const *funcTables, int nfunc,
+double *results, Workspace &workspace) const {
+#ifdef HAVE_LIBFFTW3
+	typedef typename multipole_transform::Fftw<R>::Complex Complex;
 	int nu(_ugrid.size()), nv(_vgrid.size());
-	// (re)initialize result vector to have correct size, if necessary
-	if(result.size() != nv) std::vector<double>(nv,0).swap(result);
-	for(int m = 0; m < nu; ++m) {
-		_pimpl->gdata[m][0] = (FftwReal)(_coef[m]*funcTable[m]);
-		_pimpl->gdata[m][1] = 0.;
+	multipole_transform::Kernel<R> const &kernel(
+		static_cast<multipole_transform::Kernel<R> const&>(*_pimpl->kernel));
+	typename multipole_transform::Kernel<R>::BatchPlans plans =
+		multipole_transform::getBatchPlans(kernel,nfunc);
+	// Each function uses a block of nu/2+1 complex values in the workspace buffer, which
+	// holds nu reals before the forward transform and nu/2+1 complex values after it.
+	int nhalf(nu/2+1);
+	Complex *gdata = (Complex*)workspace._pimpl->reserve<R>(nfunc*nhalf);
+	R *greal = (R*)gdata;
+	for(int i = 0; i < nfunc; ++i) {
+		R *gblock = greal + 2*nhalf*i;
+		double const *ftable = funcTables + nu*i;
+		for(int m = 0; m < nu; ++m) {
+			gblock[m] = (R)(_coef[m]*ftable[m]);
+		}
 	}
-	// Calculate the Fourier transform of gdata
-	FFTW(execute)(_pimpl->gplan);
-	// Multiply the transforms of fdata and gdata, saving the result in gdata
-	double norm(nu);
-	for(int m = 0; m < nu; ++m) {
-		double re1 = _pimpl->fdata[m][0], im1 = _pimpl->fdata[m][1];
-		double re2 = _pimpl->gdata[m][0], im2 = _pimpl->gdata[m][1];
-		_pimpl->gdata[m][0] = (FftwReal)((re1*re2 - im1*im2)/norm);
-		_pimpl->gdata[m][1] = (FftwReal)((re1*im2 + re2*im1)/norm);
+	// Transform all functions, multiply each by the kernel, then transform back to
+	// obtain the convolutions tabulated on vgrid. The new-array execute interface is
+	// thread safe, unlike plan creation. The normalization of the inverse transform
+	// is already included in the kernel.
+	multipole_transform::Fftw<R>::executeR2C(plans.forward,greal,gdata);
+	for(int i = 0; i < nfunc; ++i) {
+		multipole_transform::multiplyKernel<R>(kernel.fdata,gdata + nhalf*i,nhalf);
 	}
-	// Calculate the inverse Fourier transform that gives the convolution of
-	// the original fdata and gdata, tabulated on vgrid.
-	FFTW(execute)(_pimpl->fgplan);
-	// Rescale and copy the results back to the vector provided.
-	for(int m = 0; m < _cleanEnd - _cleanBegin; ++m) {
-		result[m] = _scale[m]*_pimpl->gdata[m + _cleanBegin][0];
+	multipole_transform::Fftw<R>::executeC2R(plans.backward,gdata,greal);
+	// Rescale and copy the results back to the array provided.
+	for(int i = 0; i < nfunc; ++i) {
+		R const *gblock = greal + 2*nhalf*i + _cleanBegin;
+		double *result = results + nv*i;
+		for(int m = 0; m < nv; ++m) {
+			result[m] = (double)(_scale[m]*gblock[m]);
+		}
 	}
 #endif
 }
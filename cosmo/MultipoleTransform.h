@@ -6,6 +6,7 @@
 #include "boost/smart_ptr.hpp"
 
 #include <vector>
+#include <string>
 
 namespace cosmo {
 	class MultipoleTransform {
@@ -15,6 +16,23 @@ namespace cosmo {
 	public:
 		enum Type { SphericalBessel, Hankel };
 		enum Strategy { EstimatePlan, MeasurePlan };
+		// Selects the floating-point precision of the internal FFT convolution, which
+		// uses the corresponding fftw3f, fftw3 or fftw3l library. Inputs and results are
+		// always double. Single precision is faster and uses half the memory but its
+		// roundoff errors are typically ~1e-6 relative to the largest result.
+		enum Precision { SinglePrecision, DoublePrecision, ExtendedPrecision };
+		// Holds the scratch memory used during a transform. A workspace can be used with
+		// any transform object and grows as needed, but must not be used by more than one
+		// thread at a time.
+		class Workspace {
+		public:
+			Workspace();
+			virtual ~Workspace();
+		private:
+			friend class MultipoleTransform;
+			class Implementation;
+			boost::scoped_ptr<Implementation> _pimpl;
+		}; // MultipoleTransform::Workspace
 		// Creates a new transform object for an arbitrary func(u) that evaluates:
 		//
 		//   T(v) = Integrate[ S(ell,u,v)*func(u) , {u,0,Infinity} ]
@@ -30,10 +48,19 @@ namespace cosmo {
 		// S'(smax) = (-veps)*S'(0). The strategy selects a tradeoff between
 		// initialization and transform speeds (via the FFTW plan strategy option).
 		// Different strategies can give different numerical results at the level
-		// of roundoff errors.
+		// of roundoff errors. Throws a RuntimeError if the requested precision is not
+		// supported by the available FFTW libraries.
 		MultipoleTransform(Type type, int ell, double vmin, double vmax, double veps,
 			Strategy strategy, int minSamplesPerCycle = 2, int minSamplesPerDecade = 40,
-			int interpolationPadding = 3);
+			int interpolationPadding = 3, Precision precision = DoublePrecision);
+		// Creates a new transform of the same type, multipole and precision as finer, but
+		// using half as many kernel samples with twice the spacing, so that its u grid
+		// is a subsample of finer's u grid and one tabulated function can be used for
+		// both transforms: getUGrid()[m] = finer.getUGrid()[2*m+offset] with
+		// offset = finer.getUGrid().size()/2 - getUGrid().size(). Our v grid covers the
+		// same range as finer's v grid, apart from at most two of finer's samples at each
+		// end, so finer should be created with enough interpolationPadding.
+		MultipoleTransform(MultipoleTransform const &finer, Strategy strategy);
 		virtual ~MultipoleTransform();
 		// Returns the truncation fraction eps such that the symmetrized S' is
 		// assumed to be zero for |s| > smax with S'(smax) = eps*S'(0). This is the
@@ -41,6 +68,8 @@ namespace cosmo {
 		double getTruncationFraction() const;
 		// Returns the minimum number of samples per cycle for this transformer.
 		int getMinSamplesPerCycle() const;
+		// Returns the precision of the internal FFT convolution.
+		Precision getPrecision() const;
 		// Returns the number of logarithmically spaced points where the symmetrized S'
 		// is evaluated for convolution. Note that this is less than the size of our
 		// u grid because of the zero padding that is added to eliminate aliasing artifacts.
@@ -63,17 +92,64 @@ namespace cosmo {
 		// values of func(u) tabulated on our u grid. The results are saved in
 		// the results vector provided, which will be resized to our vgrid size
 		// if necessary.
+		// This method uses an internal workspace so is not thread safe.
 		void transform(std::vector<double> const &funcTable,
 			std::vector<double> &result) const;
+		// Same as above but all scratch memory is taken from the workspace provided,
+		// so that different threads can safely share one transform object as long
+		// as each thread uses its own workspace.
+		void transform(std::vector<double> const &funcTable,
+			std::vector<double> &result, Workspace &workspace) const;
+		// Estimates the transforms of nfunc functions tabulated on our u grid and stored
+		// contiguously in funcTables, so that funcTables[i*nu+m] is the value of function
+		// i at ugrid[m]. The results are saved in the same order in the results vector
+		// provided, which will be resized to nfunc*nv if necessary. All functions are
+		// transformed together with batched FFTs, whose plans are created on first use
+		// for each value of nfunc and then shared. The first form uses an internal
+		// workspace so is not thread safe.
+		void transformBatch(std::vector<double> const &funcTables, int nfunc,
+			std::vector<double> &results) const;
+		void transformBatch(std::vector<double> const &funcTables, int nfunc,
+			std::vector<double> &results, Workspace &workspace) const;
+		// The Fourier transform of the tabulated kernel S' and the FFT plans used to
+		// convolve with it are built once and then shared, via a process-wide cache,
+		// by all transforms with the same type, ell, strategy and internal grid. The
+		// cache and the FFTW planner are protected by a process-wide mutex, so transform
+		// objects can be created concurrently from any threads, with or without OpenMP.
+		// Removes all kernels from the cache. Kernels used by existing transform objects
+		// remain valid until those objects are deleted.
+		static void clearKernelCache();
+		// Returns the number of kernels currently in the cache.
+		static int getKernelCacheSize();
+		// Sets the directory where kernels are also cached on disk, so that they can be
+		// reused by later processes, or disables the on-disk cache when path is empty
+		// (the default). Kernels are saved in a versioned binary format together with
+		// any FFTW wisdom accumulated with the MeasurePlan strategy, and are memory mapped
+		// when loaded. The directory must already exist and cache files are specific to
+		// the machine architecture.
+		static void setKernelCacheDirectory(std::string const &path);
+		// Returns the directory used for the on-disk kernel cache, or an empty string.
+		static std::string getKernelCacheDirectory();
 	private:
+		// Builds our kernel and grids for the specified number of v points on each side
+		// of v0, using _type, _Nf and _precision.
+		void _initialize(int ell, int Ng, double ds, double v0, Strategy strategy);
+		// Transforms nfunc functions using the implementation for our precision.
+		void _dispatch(double const *funcTables, int nfunc, double *results,
+			Workspace &workspace) const;
+		template <class R> void _transform(double const *funcTables, int nfunc,
+			double *results, Workspace &workspace) const;
 		Type _type;
-		double _eps;
+		int _ell;
+		double _eps, _ds, _v0;
 		int _minSamplesPerCycle, _Nf, _cleanBegin, _cleanEnd;
+		Precision _precision;
 		std::vector<double> _ugrid, _vgrid, _coef, _scale;
 		// We use an implementation subclass to avoid any public include dependency
 		// on fftw, since this is an optional package when building our library.
 		class Implementation;
 		boost::scoped_ptr<Implementation> _pimpl;
+		boost::scoped_ptr<Workspace> _workspace;
 	}; // MultipoleTransform
 
 	inline double MultipoleTransform::getTruncationFraction() const {
@@ -82,6 +158,10 @@ namespace cosmo {
 	inline int MultipoleTransform::getMinSamplesPerCycle() const {
 		return _minSamplesPerCycle;
 	}
+
+	inline MultipoleTransform::Precision MultipoleTransform::getPrecision() const {
+		return _precision;
+	}
 	inline int MultipoleTransform::getNumPoints() const {
 		return 2*_Nf;
 	}
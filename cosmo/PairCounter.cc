@@ -0,0 +1,235 @@
+// Created 16-Oct-2026 by agent <agent@local>
+
+#include "cosmo/PairCounter.h"
+#include "cosmo/RuntimeError.h"
+
+#include "likely/AbsBinning.h"
+#include "likely/RuntimeError.h"
+
+#include <cmath>
+#include <algorithm>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+namespace local = cosmo;
+
+namespace cosmo {
+	namespace pair_counter {
+		// Returns the number of cells of size >= minSize needed to cover extent.
+		int getNumCells(double extent, double minSize) {
+			if(!(extent > 0)) return 1;
+			double ncells = std::floor(extent/minSize);
+			if(ncells < 1) return 1;
+			if(ncells > 1<<20) return 1<<20;
+			return (int)ncells;
+		}
+		// Returns the maximum number of threads available.
+		int getMaxThreads() {
+#ifdef _OPENMP
+			return omp_get_max_threads();
+#else
+			return 1;
+#endif
+		}
+		// Returns the index of the cell containing x.
+		int getCellIndex(double x, double xmin, double cellSize, int ncells) {
+			if(ncells == 1) return 0;
+			int index = (int)((x - xmin)/cellSize);
+			if(index < 0) return 0;
+			if(index >= ncells) return ncells-1;
+			return index;
+		}
+	}
+}
+
+local::PairCounter::PairCounter(std::vector<double> const &x, std::vector<double> const &y,
+std::vector<double> const &z, likely::BinnedGrid const &grid, SeparationType type, int maxCells)
+: _grid(grid), _type(type), _ntested(0), _nused(0)
+{
+	_npoints = x.size();
+	if(y.size() != _npoints || z.size() != _npoints) {
+		throw RuntimeError("PairCounter: coordinate vectors have different sizes.");
+	}
+	if(_grid.getNAxes() != 2) {
+		throw RuntimeError("PairCounter: expected a 2D grid.");
+	}
+	if(maxCells <= 0) {
+		throw RuntimeError("PairCounter: expected maxCells > 0.");
+	}
+	likely::AbsBinningCPtr bins1(_grid.getAxisBinning(0)), bins2(_grid.getAxisBinning(1));
+	_x1min = bins1->getBinLowEdge(0);
+	_x1max = bins1->getBinHighEdge(bins1->getNBins()-1);
+	_x2min = bins2->getBinLowEdge(0);
+	_x2max = bins2->getBinHighEdge(bins2->getNBins()-1);
+	// Calculate the minimum cell size along each axis that guarantees that all pairs
+	// with a separation inside our grid are in the same or adjacent cells.
+	double minSizeXY,minSizeZ;
+	if(_type == RadiusMu) {
+		minSizeXY = minSizeZ = _x1max;
+	}
+	else {
+		minSizeXY = _x2max;
+		minSizeZ = _x1max;
+	}
+	if(!(minSizeXY > 0) || !(minSizeZ > 0)) {
+		throw RuntimeError("PairCounter: grid maximum separation must be > 0.");
+	}
+	// Find the bounding box of our points.
+	double xmin(0),xmax(0),ymin(0),ymax(0),zmin(0),zmax(0);
+	if(_npoints > 0) {
+		xmin = *std::min_element(x.begin(),x.end());
+		xmax = *std::max_element(x.begin(),x.end());
+		ymin = *std::min_element(y.begin(),y.end());
+		ymax = *std::max_element(y.begin(),y.end());
+		zmin = *std::min_element(z.begin(),z.end());
+		zmax = *std::max_element(z.begin(),z.end());
+	}
+	// Build the mesh, enlarging its cells if necessary to respect maxCells.
+	_ncx = pair_counter::getNumCells(xmax-xmin,minSizeXY);
+	_ncy = pair_counter::getNumCells(ymax-ymin,minSizeXY);
+	_ncz = pair_counter::getNumCells(zmax-zmin,minSizeZ);
+	double ncells = (double)_ncx*_ncy*_ncz;
+	if(ncells > maxCells) {
+		double shrink = std::pow(ncells/maxCells,1./3.);
+		_ncx = std::max(1,(int)(_ncx/shrink));
+		_ncy = std::max(1,(int)(_ncy/shrink));
+		_ncz = std::max(1,(int)(_ncz/shrink));
+		while((double)_ncx*_ncy*_ncz > maxCells) {
+			if(_ncx >= _ncy && _ncx >= _ncz) _ncx--;
+			else if(_ncy >= _ncz) _ncy--;
+			else _ncz--;
+		}
+	}
+	double dx((xmax-xmin)/_ncx), dy((ymax-ymin)/_ncy), dz((zmax-zmin)/_ncz);
+	// Assign each point to a cell and count the points in each cell.
+	int ntot(_ncx*_ncy*_ncz);
+	std::vector<int> cell(_npoints);
+	_cellBegin.assign(ntot+1,0);
+	for(int i = 0; i < _npoints; ++i) {
+		int ix = pair_counter::getCellIndex(x[i],xmin,dx,_ncx);
+		int iy = pair_counter::getCellIndex(y[i],ymin,dy,_ncy);
+		int iz = pair_counter::getCellIndex(z[i],zmin,dz,_ncz);
+		cell[i] = iz + _ncz*(iy + _ncy*ix);
+		_cellBegin[cell[i]+1]++;
+	}
+	for(int c = 0; c < ntot; ++c) _cellBegin[c+1] += _cellBegin[c];
+	// Sort our points by cell.
+	_x.resize(_npoints);
+	_y.resize(_npoints);
+	_z.resize(_npoints);
+	_order.resize(_npoints);
+	std::vector<int> next(_cellBegin.begin(),_cellBegin.end()-1);
+	for(int i = 0; i < _npoints; ++i) {
+		int j = next[cell[i]]++;
+		_x[j] = x[i];
+		_y[j] = y[i];
+		_z[j] = z[i];
+		_order[j] = i;
+	}
+}
+
+local::PairCounter::~PairCounter() { }
+
+void local::PairCounter::accumulate(std::vector<double> const &data, std::vector<double> const &weight,
+std::vector<double> &dsum, std::vector<double> &wsum, int nthreads) {
+	if(data.size() != _npoints || weight.size() != _npoints) {
+		throw RuntimeError("PairCounter::accumulate: data and weight must have one entry per point.");
+	}
+	int nbins = _grid.getNBinsTotal();
+	dsum.assign(nbins,0.);
+	wsum.assign(nbins,0.);
+	_ntested = _nused = 0;
+	// Copy the data and weights into our sorted order.
+	std::vector<double> d(_npoints), w(_npoints);
+	for(int j = 0; j < _npoints; ++j) {
+		d[j] = data[_order[j]];
+		w[j] = weight[_order[j]];
+	}
+	// Tabulate the (0,0,0) offset followed by the 13 neighbor offsets that visit
+	// each pair of adjacent cells exactly once.
+	int offset[14][3];
+	int noffset(0);
+	for(int ox = -1; ox <= 1; ++ox) {
+		for(int oy = -1; oy <= 1; ++oy) {
+			for(int oz = -1; oz <= 1; ++oz) {
+				if(ox > 0 || (ox == 0 && (oy > 0 || (oy == 0 && oz >= 0)))) {
+					offset[noffset][0] = ox;
+					offset[noffset][1] = oy;
+					offset[noffset][2] = oz;
+					noffset++;
+				}
+			}
+		}
+	}
+	bool rmu(_type == RadiusMu);
+	int ncells(_ncx*_ncy*_ncz);
+	if(nthreads <= 0) nthreads = pair_counter::getMaxThreads();
+#ifdef _OPENMP
+	#pragma omp parallel num_threads(nthreads)
+#endif
+	{
+		// Each thread accumulates into its own private histograms, which are summed at the end.
+		std::vector<double> mydsum(nbins,0.), mywsum(nbins,0.), separation(2);
+		long myntested(0), mynused(0);
+#ifdef _OPENMP
+		#pragma omp for schedule(dynamic)
+#endif
+		for(int c1 = 0; c1 < ncells; ++c1) {
+			int begin1(_cellBegin[c1]), end1(_cellBegin[c1+1]);
+			if(begin1 == end1) continue;
+			int ix(c1/(_ncy*_ncz)), iy((c1/_ncz)%_ncy), iz(c1%_ncz);
+			for(int k = 0; k < noffset; ++k) {
+				int jx(ix+offset[k][0]), jy(iy+offset[k][1]), jz(iz+offset[k][2]);
+				if(jx < 0 || jx >= _ncx || jy < 0 || jy >= _ncy || jz < 0 || jz >= _ncz) continue;
+				int c2 = jz + _ncz*(jy + _ncy*jx);
+				int begin2(_cellBegin[c2]), end2(_cellBegin[c2+1]);
+				for(int i = begin1; i < end1; ++i) {
+					double xi(_x[i]), yi(_y[i]), zi(_z[i]);
+					for(int j = (c1 == c2 ? i+1 : begin2); j < end2; ++j) {
+						double dx = xi - _x[j];
+						double dy = yi - _y[j];
+						double dz = zi - _z[j];
+						if(rmu) {
+							separation[0] = std::sqrt(dx*dx+dy*dy+dz*dz);
+							// The direction of a zero separation is undefined.
+							if(separation[0] == 0) continue;
+							separation[1] = std::fabs(dz/separation[0]);
+						}
+						else {
+							separation[0] = std::fabs(dz);
+							separation[1] = std::sqrt(dx*dx+dy*dy);
+						}
+						myntested++;
+						if(separation[0] < _x1min || separation[0] >= _x1max) continue;
+						if(separation[1] < _x2min || separation[1] >= _x2max) continue;
+						int index;
+						try {
+							index = _grid.getIndex(separation);
+						}
+						catch(likely::RuntimeError const &e) {
+							// This separation falls in a gap between bins.
+							continue;
+						}
+						double wgt = w[i]*w[j];
+						mydsum[index] += wgt*d[i]*d[j];
+						mywsum[index] += wgt;
+						mynused++;
+					}
+				}
+			}
+		}
+#ifdef _OPENMP
+		#pragma omp critical
+#endif
+		{
+			for(int index = 0; index < nbins; ++index) {
+				dsum[index] += mydsum[index];
+				wsum[index] += mywsum[index];
+			}
+			_ntested += myntested;
+			_nused += mynused;
+		}
+	}
+}
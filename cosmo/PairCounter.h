@@ -0,0 +1,74 @@
+// Created 16-Oct-2026 by agent <agent@local>
+
+#ifndef COSMO_PAIR_COUNTER
+#define COSMO_PAIR_COUNTER
+
+#include "likely/types.h"
+#include "likely/BinnedGrid.h"
+
+#include "cosmo/types.h"
+
+#include <vector>
+
+namespace cosmo {
+	class PairCounter {
+	// Accumulates weighted statistics of pairs drawn from a catalog of points, binned
+	// in their separation. Points are sorted into a chaining mesh whose cells are at
+	// least as large as the maximum binned separation along each axis, so that only
+	// pairs in the same or adjacent cells ever need to be compared. The line of sight
+	// is assumed to be along the z axis.
+	public:
+		// Pair separations are binned either in (r,mu) with mu = |dz|/r, or in
+		// (r_par,r_perp) with r_par = |dz| and r_perp = sqrt(dx^2+dy^2).
+		enum SeparationType { RadiusMu, ParallelPerpendicular };
+		// Creates a new pair counter for points at the cartesian coordinates (x,y,z)
+		// in Mpc/h, which must all have the same size. Separations will be binned on
+		// the specified 2D grid, whose axes are interpreted according to type. The mesh
+		// will use at most maxCells cells, which are enlarged as necessary.
+		PairCounter(std::vector<double> const &x, std::vector<double> const &y,
+			std::vector<double> const &z, likely::BinnedGrid const &grid,
+			SeparationType type, int maxCells = 1 << 24);
+		virtual ~PairCounter();
+		// Accumulates the sums of w(i)*w(j)*d(i)*d(j) and w(i)*w(j) over all distinct
+		// pairs (i,j) whose separation falls within our grid, using the values d and
+		// weights w provided for each point. Results are indexed by the global grid bin
+		// index and saved in the vectors provided, which will be resized if necessary.
+		// When built with OpenMP, cells are distributed over nthreads threads that
+		// each accumulate private histograms, or over all available threads if
+		// nthreads <= 0.
+		void accumulate(std::vector<double> const &data, std::vector<double> const &weight,
+			std::vector<double> &dsum, std::vector<double> &wsum, int nthreads = 1);
+		// Returns the number of points in our catalog.
+		int getNumPoints() const;
+		// Returns the number of chaining mesh cells along each axis.
+		int getNumCellsX() const;
+		int getNumCellsY() const;
+		int getNumCellsZ() const;
+		// Returns the number of candidate pairs whose separation was calculated, and the
+		// number of those that were binned, during the last call to accumulate().
+		long getNumPairsTested() const;
+		long getNumPairsUsed() const;
+	private:
+		likely::BinnedGrid _grid;
+		SeparationType _type;
+		double _x1min, _x1max, _x2min, _x2max;
+		int _npoints, _ncx, _ncy, _ncz;
+		long _ntested, _nused;
+		// Point coordinates and original indices, sorted by cell.
+		std::vector<double> _x, _y, _z;
+		std::vector<int> _order;
+		// Offsets into the sorted point arrays where each cell begins, with an extra
+		// entry at the end so that cell i spans [_cellBegin[i],_cellBegin[i+1]).
+		std::vector<int> _cellBegin;
+	}; // PairCounter
+
+	inline int PairCounter::getNumPoints() const { return _npoints; }
+	inline int PairCounter::getNumCellsX() const { return _ncx; }
+	inline int PairCounter::getNumCellsY() const { return _ncy; }
+	inline int PairCounter::getNumCellsZ() const { return _ncz; }
+	inline long PairCounter::getNumPairsTested() const { return _ntested; }
+	inline long PairCounter::getNumPairsUsed() const { return _nused; }
+
+} // cosmo
+
+#endif // COSMO_PAIR_COUNTER
@@ -1,6 +1,7 @@
 // Created 13-Jan-2014 by David Kirkby (University of California, Irvine) <dkirkby@uci.edu>
 
 #include "cosmo/TabulatedPower.h"
+#include "cosmo/CubicSpline.h"
 #include "cosmo/RuntimeError.h"
 
 #include "likely/Interpolator.h"
@@ -18,6 +19,9 @@ namespace cosmo {
 		// |P1-P2| < eps, then use constant extrapolation. Otherwise, if P1*P2 < 0
 		// then throw a RuntimeError.
 		PowerLawExtrapolator(double k1,double P1,double k2,double P2,double eps=1e-14) {
+			fit(k1,P1,k2,P2,eps);
+		}
+		void fit(double k1,double P1,double k2,double P2,double eps) {
 			if(std::fabs(P1-P2) < eps) {
 				a = 0;
 				c = 0.5*(P1+P2);
@@ -68,11 +72,32 @@ _maxRelError(maxRelError)
 			<< " samples/decade)" << std::endl;
 	}
 	// Build a spline interpolator in log(k) and P(k)
-	_interpolator.reset(new likely::Interpolator(logk,Pk,"cspline"));
+	_k = k;
+	_interpolator.reset(new CubicSpline(logk));
+	_fit(Pk,extrapolateBelow,extrapolateAbove,verbose);
+}
+
+void local::TabulatedPower::update(std::vector<double> const &Pk) {
+	if(Pk.size() != _k.size()) {
+		throw RuntimeError("TabulatedPower::update: input vector has the wrong size.");
+	}
+	bool extrapolateBelow(!!_extrapolateBelow), extrapolateAbove(!!_extrapolateAbove);
+	_fit(Pk,extrapolateBelow,extrapolateAbove,false);
+}
+
+void local::TabulatedPower::_fit(std::vector<double> const &Pk,
+bool extrapolateBelow, bool extrapolateAbove, bool verbose) {
+	std::vector<double> const &k(_k);
+	_interpolator->fit(Pk);
 	// Estimate a power law for extrapolating below kmin, if requested
 	double eps(1e-14);
 	if(extrapolateBelow) {
-		_extrapolateBelow.reset(new PowerLawExtrapolator(k[0],Pk[0],k[2],Pk[2],eps));
+		if(_extrapolateBelow) {
+			_extrapolateBelow->fit(k[0],Pk[0],k[2],Pk[2],eps);
+		}
+		else {
+			_extrapolateBelow.reset(new PowerLawExtrapolator(k[0],Pk[0],k[2],Pk[2],eps));
+		}
 		// Check how well the extrapolation does at k[1]
 		double P1 = (*_extrapolateBelow)(k[1]);
 		double abserr = std::fabs(P1 - Pk[1]);
@@ -81,14 +106,19 @@ _maxRelError(maxRelError)
 			std::cout << "TabulatedPower: errors for extrapolation below are "
 				<< relerr << " (rel) " << abserr << " (abs)" << std::endl;
 		}
-		if(abserr > eps && relerr > maxRelError) {
+		if(abserr > eps && relerr > _maxRelError) {
 			throw RuntimeError("TabulatedPower: cannot reliably extrapolate below kmin.");
 		}
 	}
 	// Estimate a power law for extrapolating above kmax, if requested
 	if(extrapolateAbove) {
 		int n = k.size();
-		_extrapolateAbove.reset(new PowerLawExtrapolator(k[n-3],Pk[n-3],k[n-1],Pk[n-1],eps));
+		if(_extrapolateAbove) {
+			_extrapolateAbove->fit(k[n-3],Pk[n-3],k[n-1],Pk[n-1],eps);
+		}
+		else {
+			_extrapolateAbove.reset(new PowerLawExtrapolator(k[n-3],Pk[n-3],k[n-1],Pk[n-1],eps));
+		}
 		// Check how well the extrapolation does at k[n-2]
 		double Pn2 = (*_extrapolateAbove)(k[n-2]);
 		double abserr = std::fabs(Pn2 - Pk[n-2]);
@@ -97,7 +127,7 @@ _maxRelError(maxRelError)
 			std::cout << "TabulatedPower: errors for extrapolation above are "
 				<< relerr << " (rel) " << abserr << " (abs)" << std::endl;
 		}
-		if(abserr > eps && relerr > maxRelError) {
+		if(abserr > eps && relerr > _maxRelError) {
 			throw RuntimeError("TabulatedPower: cannot reliably extrapolate above kmax.");
 		}
 	}
@@ -134,18 +164,13 @@ double local::TabulatedPower::operator()(double k) const {
 
 local::TabulatedPowerCPtr local::TabulatedPower::createDelta(
 TabulatedPowerCPtr other, bool verbose) const {
-	likely::Interpolator::CoordinateValues logkGrid = _interpolator->getXGrid();
-	likely::Interpolator::CoordinateValues deltaGrid = _interpolator->getYGrid();
-	likely::Interpolator::CoordinateValues kGrid;
-	int n(logkGrid.size());
-	kGrid.reserve(n);
+	std::vector<double> deltaGrid(_interpolator->getY());
+	int n(_k.size());
 	for(int i = 0; i < n; ++i) {
-		double k = std::exp(logkGrid[i]);
-		kGrid.push_back(k);
-		deltaGrid[i] -= (*other)(k);
+		deltaGrid[i] -= (*other)(_k[i]);
 	}
 	bool extrapolateBelow(!!_extrapolateBelow), extrapolateAbove(!!_extrapolateAbove);
-	TabulatedPowerCPtr delta(new TabulatedPower(kGrid,deltaGrid,
+	TabulatedPowerCPtr delta(new TabulatedPower(_k,deltaGrid,
 		extrapolateBelow,extrapolateAbove,_maxRelError,verbose));
 	return delta;
 }
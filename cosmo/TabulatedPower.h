@@ -8,6 +8,7 @@
 
 #include "boost/smart_ptr.hpp"
 
+#include <vector>
 #include <iosfwd>
 
 namespace cosmo {
@@ -29,6 +30,10 @@ namespace cosmo {
 			bool extrapolateBelow = false, bool extrapolateAbove = false,
 			double maxRelError = 1e-3, bool verbose = false);
 		virtual ~TabulatedPower();
+		// Replaces the tabulated values of P(k) using the same k grid and options that we
+		// were created with, and repeats the extrapolation checks. Reuses all of our
+		// internal storage, so never allocates memory.
+		void update(std::vector<double> const &Pk);
 		// Evaluates P(k) for the specified k. Always returns 0 for k <= 0.
 		double operator()(double k) const;
 		// Returns the interpolation limits
@@ -43,9 +48,12 @@ namespace cosmo {
 
 	private:
 		double _kmin, _kmax, _maxRelError;
+		std::vector<double> _k;
 		class PowerLawExtrapolator;
 		boost::scoped_ptr<PowerLawExtrapolator> _extrapolateBelow, _extrapolateAbove;
-		likely::InterpolatorPtr _interpolator;
+		boost::scoped_ptr<CubicSpline> _interpolator;
+		void _fit(std::vector<double> const &Pk, bool extrapolateBelow, bool extrapolateAbove,
+			bool verbose);
 	}; // TabulatedPower
 
 	inline double TabulatedPower::getKMin() const { return _kmin; }
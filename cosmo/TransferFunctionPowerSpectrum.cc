@@ -128,6 +128,46 @@ double local::getMultipole(likely::GenericFunctionPtr fOfMuPtr, int ell, double
     return 2*integrator.integrateSmooth(0,1);
 }
 
+namespace cosmo {
+    namespace transfer_function_power_spectrum {
+        // Evaluates the Legendre polynomial P_n(x) using the three-term recurrence and
+        // returns its value, also saving its derivative dP_n/dx in dp.
+        double legendreWithDerivative(int n, double x, double &dp) {
+            double p0(1), p1(x);
+            for(int j = 2; j <= n; ++j) {
+                double p2 = ((2*j-1)*x*p1 - (j-1)*p0)/j;
+                p0 = p1;
+                p1 = p2;
+            }
+            dp = n*(x*p1 - p0)/(x*x - 1);
+            return p1;
+        }
+    } // transfer_function_power_spectrum
+} // cosmo::
+
+void local::getGaussLegendreRule(int n, std::vector<double> &abscissas, std::vector<double> &weights) {
+    if(n <= 0) {
+        throw RuntimeError("getGaussLegendreRule: expected n > 0.");
+    }
+    abscissas.resize(n);
+    weights.resize(n);
+    double pi(4*std::atan(1));
+    // Find each root of P_n in the upper half by Newton's method, starting from a
+    // standard asymptotic estimate, and use symmetry for the lower half.
+    for(int i = 0; i < (n+1)/2; ++i) {
+        double x(std::cos(pi*(i+0.75)/(n+0.5))), dp;
+        for(int iter = 0; iter < 100; ++iter) {
+            double dx = transfer_function_power_spectrum::legendreWithDerivative(n,x,dp)/dp;
+            x -= dx;
+            if(std::fabs(dx) < 1e-15) break;
+        }
+        transfer_function_power_spectrum::legendreWithDerivative(n,x,dp);
+        abscissas[i] = -x;
+        abscissas[n-1-i] = x;
+        weights[i] = weights[n-1-i] = 2/((1-x*x)*dp*dp);
+    }
+}
+
 // explicit template instantiation for creating a function pointer to a TransferFunctionPowerSpectrum.
 
 #include "likely/function_impl.h"
@@ -10,6 +10,8 @@
 #include "boost/function.hpp"
 #include "boost/smart_ptr.hpp"
 
+#include <vector>
+
 namespace cosmo {
     // Represents an isotropic power spectrum of 3D inhomogeneities based on a model of
     // primordial fluctuations and a transfer function.
@@ -56,6 +58,10 @@ namespace cosmo {
     // Returns the specified multipole projection of the function provided, calculated
     // using numerical integration over 0 < mu < 1. Only even 0 <= ell <= 12 are implemented.
     double getMultipole(likely::GenericFunctionPtr fOfMuPtr, int ell, double epsAbs = 1e-6, double epsRel = 1e-6);
+    // Calculates the n-point Gauss-Legendre quadrature rule on [-1,+1] and saves the
+    // abscissas (in increasing order) and weights in the vectors provided, which will
+    // be resized if necessary. The rule is exact for polynomials of degree < 2n.
+    void getGaussLegendreRule(int n, std::vector<double> &abscissas, std::vector<double> &weights);
 	
 } // cosmo
 
@@ -12,11 +12,13 @@
 #include "cosmo/BaryonPerturbations.h"
 #include "cosmo/BroadbandPower.h"
 
+#include "cosmo/CubicSpline.h"
 #include "cosmo/TabulatedPower.h"
 #include "cosmo/TransferFunctionPowerSpectrum.h"
 #include "cosmo/PowerSpectrumCorrelationFunction.h"
 #include "cosmo/OneDimensionalPowerSpectrum.h"
 #include "cosmo/RsdCorrelationFunction.h"
+#include "cosmo/KMuPkBatchFunction.h"
 #include "cosmo/MultipoleTransform.h"
 #include "cosmo/AdaptiveMultipoleTransform.h"
 #include "cosmo/DistortedPowerCorrelation.h"
@@ -26,3 +28,8 @@
 #include "cosmo/AbsGaussianRandomFieldGenerator.h"
 #include "cosmo/FftGaussianRandomFieldGenerator.h"
 #include "cosmo/TestFftGaussianRandomFieldGenerator.h"
+
+#include "cosmo/PairCounter.h"
+#include "cosmo/MemoryMappedFile.h"
+#include "cosmo/BinaryCatalogReader.h"
+#include "cosmo/BinaryCatalogWriter.h"
@@ -19,7 +19,10 @@ namespace cosmo {
     class AbsGaussianRandomFieldGenerator;
     typedef boost::shared_ptr<AbsGaussianRandomFieldGenerator> AbsGaussianRandomFieldGeneratorPtr;
 
+    class CubicSpline;
+
     class TabulatedPower;
+    typedef boost::shared_ptr<TabulatedPower> TabulatedPowerPtr;
     typedef boost::shared_ptr<const TabulatedPower> TabulatedPowerCPtr;
 
     class AdaptiveMultipoleTransform;
@@ -38,6 +41,18 @@ namespace cosmo {
     typedef boost::shared_ptr<DistortedPowerCorrelationHybrid> DistortedPowerCorrelationHybridPtr;
     typedef boost::shared_ptr<const DistortedPowerCorrelationHybrid> DistortedPowerCorrelationHybridCPtr;
 
+    class PairCounter;
+    typedef boost::shared_ptr<PairCounter> PairCounterPtr;
+
+    // Identifies the storage type of a column in a binary catalog file.
+    enum CatalogColumnType { Float64Column = 0, Float32Column = 1 };
+
+    class BinaryCatalogReader;
+    typedef boost::shared_ptr<BinaryCatalogReader> BinaryCatalogReaderPtr;
+
+    class BinaryCatalogWriter;
+    typedef boost::shared_ptr<BinaryCatalogWriter> BinaryCatalogWriterPtr;
+
     // Represents a function that returns a dimensionless transfer function value T(k)
     // given an input wavenumber k in 1/(Mpc/h).
     typedef boost::function<double (double)> TransferFunction;
@@ -60,6 +75,20 @@ namespace cosmo {
     // Represents a function of (k,mu,Pk)
     typedef boost::function<double (double,double,double)> KMuPkFunction;
     typedef boost::shared_ptr<const KMuPkFunction> KMuPkFunctionCPtr;
+
+    // Represents a function of (k,mu,Pk) evaluated at n points at once, which saves
+    // the value at (k[i],mu[i],Pk[i]) in result[i]. See createKMuPkBatchFunction()
+    // for an adapter from the scalar form.
+    typedef boost::function<void (int n, double const *k, double const *mu, double const *Pk,
+        double *result)> KMuPkBatchFunction;
+    typedef boost::shared_ptr<const KMuPkBatchFunction> KMuPkBatchFunctionCPtr;
+
+    // Represents a function of (k,mu,Pk) that is a polynomial in mu^2 of some degree N,
+    // Sum[c_j(k,Pk)*mu^(2j),{j,0,N}], via its coefficients evaluated at n values of
+    // (k,Pk), with c_j(k[i],Pk[i]) saved in coefs[i*(N+1)+j].
+    typedef boost::function<void (int n, double const *k, double const *Pk,
+        double *coefs)> MuSquaredPolynomialFunction;
+    typedef boost::shared_ptr<const MuSquaredPolynomialFunction> MuSquaredPolynomialFunctionCPtr;
     
 } // cosmo
 
@@ -8,16 +8,147 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <utility>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
 
 namespace po = boost::program_options;
 
+// Describes one contiguous range of whole input lines and the results of converting them.
+struct Chunk {
+    char const *begin, *end;
+    // Number of input lines in this chunk, including blank and bad lines.
+    int nlines;
+    // Number of points converted and the bounding box of the converted points.
+    int nconverted;
+    double Xmin,Xmax,Ymin,Ymax,Zmin,Zmax;
+    // Diagnostic messages, keyed by the line index within this chunk.
+    std::vector<std::pair<int,std::string> > messages;
+    // Non-empty if this chunk could not be converted.
+    std::string error;
+    // Formatted output lines, or the converted coordinates for binary output.
+    std::string output;
+    std::vector<double> X,Y,Z;
+};
+
+// Parses the lines in [chunk.begin,chunk.end), converts them to cartesian coordinates,
+// and saves the results in chunk.X,Y,Z if binary is set, or else formats them in chunk.output.
+void convertChunk(Chunk &chunk, cosmo::AbsHomogeneousUniverse const &cosmology, double deg2rad,
+bool binary) {
+    std::vector<double> raBlock, decBlock, zBlock, sBlock;
+    chunk.nlines = chunk.nconverted = 0;
+    chunk.messages.clear();
+    chunk.error.clear();
+    chunk.output.clear();
+    chunk.X.clear();
+    chunk.Y.clear();
+    chunk.Z.clear();
+    // Lines are copied into a null-terminated buffer before parsing since the mapped
+    // input is not null terminated.
+    const int maxLength(1024);
+    char line[maxLength+1], message[maxLength+64];
+    char const *next(chunk.begin);
+    while(next < chunk.end) {
+        char const *eol = static_cast<char const*>(std::memchr(next,'\n',chunk.end-next));
+        if(0 == eol) eol = chunk.end;
+        int length(eol-next), lineIndex(chunk.nlines++);
+        char const *start(next);
+        next = eol+1;
+        if(length > maxLength) {
+            chunk.messages.push_back(std::make_pair(lineIndex,std::string("Line is too long to parse.")));
+            continue;
+        }
+        std::memcpy(line,start,length);
+        line[length] = 0;
+        char *ptr(line), *end;
+        double values[3];
+        int nvalues(0);
+        for(; nvalues < 3; ++nvalues) {
+            values[nvalues] = std::strtod(ptr,&end);
+            if(end == ptr) break;
+            ptr = end;
+        }
+        if(nvalues < 3) {
+            // Silently skip blank lines.
+            while(*ptr == ' ' || *ptr == '\t' || *ptr == '\r') ++ptr;
+            if(0 == nvalues && 0 == *ptr) continue;
+            chunk.messages.push_back(std::make_pair(lineIndex,std::string("Unable to parse ra dec z.")));
+            continue;
+        }
+        if(values[2] <= 0) {
+            std::sprintf(message,"Bad redshift : z = %g",values[2]);
+            chunk.messages.push_back(std::make_pair(lineIndex,std::string(message)));
+            continue;
+        }
+        raBlock.push_back(values[0]);
+        decBlock.push_back(values[1]);
+        zBlock.push_back(values[2]);
+    }
+    int n(zBlock.size());
+    if(0 == n) return;
+    sBlock.resize(n);
+    try {
+        cosmology.getLineOfSightComovingDistances(n,&zBlock[0],&sBlock[0]);
+    }
+    catch(std::exception const &e) {
+        chunk.error = e.what();
+        return;
+    }
+    if(binary) {
+        chunk.X.resize(n);
+        chunk.Y.resize(n);
+        chunk.Z.resize(n);
+    }
+    else {
+        // Each output line needs at most 3*(13+1) characters with the default %g format.
+        chunk.output.reserve(48*n);
+    }
+    char buffer[128];
+    for(int i = 0; i < n; ++i) {
+        double s(sBlock[i]);
+        double RA(deg2rad*raBlock[i]), DEC(deg2rad*decBlock[i]);
+        double cosDEC(std::cos(DEC));
+        double X(s*cosDEC*std::cos(RA)), Y(s*cosDEC*std::sin(RA)), Z(s*std::sin(DEC));
+        if(binary) {
+            chunk.X[i] = X;
+            chunk.Y[i] = Y;
+            chunk.Z[i] = Z;
+        }
+        else {
+            // This matches the default formatting of operator<<.
+            int nchars = std::sprintf(buffer,"%g %g %g\n",X,Y,Z);
+            chunk.output.append(buffer,nchars);
+        }
+        if(0 == i) {
+            chunk.Xmin = chunk.Xmax = X;
+            chunk.Ymin = chunk.Ymax = Y;
+            chunk.Zmin = chunk.Zmax = Z;
+        }
+        else {
+            if(X < chunk.Xmin) chunk.Xmin = X;
+            else if(X > chunk.Xmax) chunk.Xmax = X;
+            if(Y < chunk.Ymin) chunk.Ymin = Y;
+            else if(Y > chunk.Ymax) chunk.Ymax = Y;
+            if(Z < chunk.Zmin) chunk.Zmin = Z;
+            else if(Z > chunk.Zmax) chunk.Zmax = Z;
+        }
+    }
+    chunk.nconverted = n;
+}
+
 int main(int argc, char **argv) {
     
     // Configure command-line option processing
     po::options_description cli("Cosmology calculator");
-    double OmegaLambda,OmegaMatter,OmegaBaryon,hubbleConstant,cmbTemp,spectralIndex,
-        zval,kval,kmin,kmax,rval,rmin,rmax;
-    int nk,nr;
+    double OmegaLambda,OmegaMatter;
+    int nthreads,chunkSize;
     std::string inputName, outputName;
     cli.add_options()
         ("help,h", "Prints this info and exits.")
@@ -31,6 +162,11 @@ int main(int argc, char **argv) {
         ("output-name,o", po::value<std::string>(&outputName)->default_value(""),
             "Name of the output file containing x,y,z values to write.")
         ("bounds", "Calculates and prints bounding box of converted points.")
+        ("threads", po::value<int>(&nthreads)->default_value(0),
+            "Number of threads to use for conversion (or zero to use all available cores)")
+        ("chunk-size", po::value<int>(&chunkSize)->default_value(1<<20),
+            "Approximate number of input bytes converted by each thread at a time.")
+        ("binary", "Writes the output as a binary catalog with columns x,y,z.")
         ;
 
     // do the command line parsing now
@@ -47,56 +183,146 @@ int main(int argc, char **argv) {
         std::cout << cli << std::endl;
         return 1;
     }
-    bool verbose(vm.count("verbose")), bounds(vm.count("bounds"));
+    bool verbose(vm.count("verbose")), bounds(vm.count("bounds")), binary(vm.count("binary"));
+    if(chunkSize <= 0) {
+        std::cerr << "Expected chunk-size > 0." << std::endl;
+        return -1;
+    }
+#ifdef _OPENMP
+    if(nthreads <= 0) nthreads = omp_get_max_threads();
+#else
+    nthreads = 1;
+#endif
 
     if(OmegaMatter == 0) OmegaMatter = 1 - OmegaLambda;
     cosmo::AbsHomogeneousUniversePtr cosmology(
         new cosmo::LambdaCdmUniverse(OmegaLambda,OmegaMatter));
-    
-    std::ofstream out(outputName.c_str());
-    std::ifstream in(inputName.c_str());
-    double ra,dec,z;
-    int count(0);
+    // Build the distance table now, before it is shared by our threads.
+    cosmology->getLineOfSightComovingDistance(0);
+
+    boost::scoped_ptr<cosmo::MemoryMappedFile> input;
+    try {
+        input.reset(new cosmo::MemoryMappedFile(inputName));
+    }
+    catch(std::exception const &e) {
+        std::cerr << e.what() << std::endl;
+        return -2;
+    }
+    std::ofstream out;
+    boost::scoped_ptr<cosmo::BinaryCatalogWriter> writer;
+    char const *next(input->getData()), *last(input->getData() + input->getSize());
+    if(binary) {
+        // Allocate one row per input line, then trim the catalog once we know how many
+        // lines were actually converted.
+        long nlines(0);
+        for(char const *ptr = next; ptr < last; ++nlines) {
+            char const *eol = static_cast<char const*>(std::memchr(ptr,'\n',last-ptr));
+            ptr = eol ? eol+1 : last;
+        }
+        std::vector<std::string> names;
+        names.push_back("x");
+        names.push_back("y");
+        names.push_back("z");
+        try {
+            writer.reset(new cosmo::BinaryCatalogWriter(outputName,names,nlines));
+        }
+        catch(std::exception const &e) {
+            std::cerr << e.what() << std::endl;
+            return -2;
+        }
+    }
+    else {
+        out.open(outputName.c_str(), std::ios::out | std::ios::binary);
+    }
+
+    // Convert the input in batches of chunks, with one batch in memory at a time. Chunks
+    // within a batch are converted in parallel, then written out in their input order.
+    int count(0), nconverted(0);
     double deg2rad(atan2(1,0)/90);
     double Xmin,Xmax,Ymin,Ymax,Zmin,Zmax;
-    while(in.good() && !in.eof()) {
-        in >> ra >> dec >> z;
-        if(!in.good() || in.eof()) break;
-        if(z <= 0) {
-            std::cerr << "Bad redshift on line " << (count+1) << " : z = " << z << std::endl;
+    int chunksPerBatch(4*nthreads);
+    std::vector<Chunk> batch(chunksPerBatch);
+    while(next < last) {
+        // Divide the next part of the input into chunks that end on a line boundary.
+        int nchunks(0);
+        while(next < last && nchunks < chunksPerBatch) {
+            Chunk &chunk(batch[nchunks++]);
+            chunk.begin = next;
+            if(last - next <= chunkSize) {
+                chunk.end = last;
+            }
+            else {
+                char const *eol = static_cast<char const*>(std::memchr(next+chunkSize,'\n',last-next-chunkSize));
+                chunk.end = eol ? eol+1 : last;
+            }
+            next = chunk.end;
         }
-        else {
-            double s(cosmology->getLineOfSightComovingDistance(z));
-            double RA(deg2rad*ra), DEC(deg2rad*dec);
-            double cosDEC(std::cos(DEC));
-            double X(s*cosDEC*std::cos(RA)), Y(s*cosDEC*std::sin(RA)), Z(s*std::sin(DEC));
-            out << X << ' ' << Y << ' ' << Z << std::endl;
-            if(bounds) {
-                if(0 == count) {
-                    Xmin = Xmax = X;
-                    Ymin = Ymax = Y;
-                    Zmin = Zmax = Z;
+#ifdef _OPENMP
+        #pragma omp parallel for schedule(dynamic) num_threads(nthreads)
+#endif
+        for(int i = 0; i < nchunks; ++i) {
+            convertChunk(batch[i],*cosmology,deg2rad,binary);
+        }
+        // Write the converted chunks in order and merge their bounding boxes.
+        for(int i = 0; i < nchunks; ++i) {
+            Chunk &chunk(batch[i]);
+            for(int j = 0; j < chunk.messages.size(); ++j) {
+                std::cerr << "Line " << (count+chunk.messages[j].first+1) << ": "
+                    << chunk.messages[j].second << std::endl;
+            }
+            if(chunk.error.length() > 0) {
+                std::cerr << "Unable to convert lines " << (count+1) << '-' << (count+chunk.nlines)
+                    << ": " << chunk.error << std::endl;
+                return -3;
+            }
+            if(binary) {
+                if(chunk.nconverted > 0) {
+                    writer->setColumn(0,&chunk.X[0],nconverted,chunk.nconverted);
+                    writer->setColumn(1,&chunk.Y[0],nconverted,chunk.nconverted);
+                    writer->setColumn(2,&chunk.Z[0],nconverted,chunk.nconverted);
+                }
+            }
+            else {
+                out.write(chunk.output.data(),chunk.output.size());
+            }
+            if(bounds && chunk.nconverted > 0) {
+                if(0 == nconverted) {
+                    Xmin = chunk.Xmin; Xmax = chunk.Xmax;
+                    Ymin = chunk.Ymin; Ymax = chunk.Ymax;
+                    Zmin = chunk.Zmin; Zmax = chunk.Zmax;
                 }
                 else {
-                    if(X < Xmin) Xmin = X;
-                    else if(X > Xmax) Xmax = X;
-                    if(Y < Ymin) Ymin = Y;
-                    else if(Y > Ymax) Ymax = Y;
-                    if(Z < Zmin) Zmin = Z;
-                    else if(Z > Zmax) Zmax = Z;
+                    if(chunk.Xmin < Xmin) Xmin = chunk.Xmin;
+                    if(chunk.Xmax > Xmax) Xmax = chunk.Xmax;
+                    if(chunk.Ymin < Ymin) Ymin = chunk.Ymin;
+                    if(chunk.Ymax > Ymax) Ymax = chunk.Ymax;
+                    if(chunk.Zmin < Zmin) Zmin = chunk.Zmin;
+                    if(chunk.Zmax > Zmax) Zmax = chunk.Zmax;
                 }
             }
+            count += chunk.nlines;
+            nconverted += chunk.nconverted;
         }
-        count++;
     }
     if(bounds) {
         std::cout << "Bounding box [" << Xmin << ',' << Xmax << "] x [" << Ymin << ',' << Ymax
             << "] x [" << Zmin << ',' << Zmax << "]" << std::endl;
     }
     if(verbose) {
-        std::cout << "Converted " << count << " lines." << std::endl;
+        std::cout << "Converted " << nconverted << " of " << count << " lines." << std::endl;
+    }
+    if(binary) {
+        try {
+            writer->setNumRows(nconverted);
+            writer->close();
+        }
+        catch(std::exception const &e) {
+            std::cerr << e.what() << std::endl;
+            return -4;
+        }
+    }
+    else {
+        out.close();
     }
-    in.close();
-    out.close();
     return 0;
-}
\ No newline at end of file
+}
@@ -12,13 +12,13 @@
 #include "likely/likely.h"
 
 #include "boost/program_options.hpp"
-#include "boost/bind.hpp"
 
 #include <fstream>
 #include <iostream>
 #include <cmath>
 #include <vector>
 #include <list>
+#include <algorithm>
 
 namespace po = boost::program_options;
 namespace lk = likely;
@@ -214,12 +214,11 @@ int main(int argc, char **argv) {
                 // Create a power spectrum from the EH97 parameterization...
 
                 // Create a sharable pointer to the matter transfer function (this will
-                // keep baryonsPtr alive)
-                cosmo::TransferFunctionPtr transferPtr(new cosmo::TransferFunction(boost::bind(
-                    noWiggles ?
-                        &cosmo::BaryonPerturbations::getNoWigglesTransfer :
-                        &cosmo::BaryonPerturbations::getMatterTransfer,
-                    baryonsPtr,_1)));
+                // keep baryonsPtr alive). The transfer function is tabulated once with the
+                // array API, covering at least the range we save, since it is evaluated
+                // many times below to normalize and tabulate the power spectrum.
+                cosmo::TransferFunctionPtr transferPtr(cosmo::createTabulatedTransferFunction(
+                    baryonsPtr,noWiggles,std::min(kmin,1e-4),std::max(kmax,1e2)));
 
                 // Use COBE  n=1 normalization by default
                 double deltaH = 1.94e-5*std::pow(OmegaMatter,-0.785-0.05*std::log(OmegaMatter));
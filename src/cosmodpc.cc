@@ -105,6 +105,91 @@ public:
         }
         return contdistortion*nonlinear*nlcorrection*linear*linear*pixelization;
     }
+    // Returns true if this model is a polynomial in mu^2, which requires that the only
+    // mu dependence comes from linear redshift space effects.
+    bool isPolynomial() const {
+        return _snlPar2 == _snlPerp2 && _kc == 0 && _kcAlt == 0 && _qnl == 0 && _knl == 0 &&
+            _pixPar == 0;
+    }
+    // Calculates the coefficients of 1, mu^2 and mu^4 for this model at n points, which
+    // are only valid when isPolynomial() is true.
+    void getCoefficients(int n, double const *k, double const *pk, double *coefs) const {
+        for(int i = 0; i < n; ++i) {
+            double bias(_bias);
+            if(_radStrength != 0) {
+                double s(_meanFreePath*k[i]);
+                double Ws = std::atan(s)/s;
+                bias += _radStrength*Ws/(1+_biasAbsorberResponse*Ws);
+            }
+            double nonlinear = std::exp(-0.5*k[i]*k[i]*_snlPerp2);
+            coefs[3*i] = nonlinear*bias*bias;
+            coefs[3*i+1] = nonlinear*2*bias*_biasbeta;
+            coefs[3*i+2] = nonlinear*_biasbeta*_biasbeta;
+        }
+    }
+    // Evaluates the same model as operator() at n points, with each optional factor
+    // applied in its own pass so that there are no per-point branches.
+    void evaluate(int n, double const *k, double const *mu, double const *pk, double *result) const {
+        // Calculate non-linear broadening and the overall large-scale Lya tracer bias
+        if(_radStrength != 0) {
+            for(int i = 0; i < n; ++i) {
+                double mu2(mu[i]*mu[i]), s(_meanFreePath*k[i]);
+                double Ws = std::atan(s)/s;
+                double linear = _bias + _radStrength*Ws/(1+_biasAbsorberResponse*Ws) + _biasbeta*mu2;
+                double snl2 = _snlPar2*mu2 + (1 - mu2)*_snlPerp2;
+                result[i] = std::exp(-0.5*k[i]*k[i]*snl2)*linear*linear;
+            }
+        }
+        else {
+            for(int i = 0; i < n; ++i) {
+                double mu2(mu[i]*mu[i]);
+                double linear = _bias + _biasbeta*mu2;
+                double snl2 = _snlPar2*mu2 + (1 - mu2)*_snlPerp2;
+                result[i] = std::exp(-0.5*k[i]*k[i]*snl2)*linear*linear;
+            }
+        }
+        // Calculate continuum fitting distortion
+        if(_kcAlt != 0) {
+            for(int i = 0; i < n; ++i) {
+                result[i] *= std::tanh(std::pow(std::fabs(k[i]*mu[i])/_kcAlt,_pc));
+            }
+        }
+        else if(_kc != 0) {
+            for(int i = 0; i < n; ++i) {
+                double k1 = std::pow(std::fabs(k[i]*mu[i])/_kc + 1,0.75);
+                result[i] *= std::pow((k1-1/k1)/(k1+1/k1),_pc);
+            }
+        }
+        // Calculate non-linear correction, or the alternative (McDonald 2003)
+        if(_knl != 0) {
+            for(int i = 0; i < n; ++i) {
+                double kvel = _kv0*std::pow(1+k[i]/_kvi,_pvi);
+                double growth = std::pow(k[i]/_knl,_pnl);
+                double pressure = std::pow(k[i]/_kpp,_pp);
+                double pecvelocity = std::pow(std::fabs(k[i]*mu[i])/kvel,_pv);
+                result[i] *= std::exp(growth-pressure-pecvelocity);
+            }
+        }
+        else if(_qnl != 0) {
+            double sigma8Sim(0.8338);
+            double pi(4*std::atan(1));
+            double scale = (sigma8Sim/_sigma8)*(sigma8Sim/_sigma8)/(2*pi*pi);
+            for(int i = 0; i < n; ++i) {
+                double growth = _qnl*k[i]*k[i]*k[i]*pk[i]*scale;
+                double pecvelocity = std::pow(k[i]/_kv,_av)*std::pow(std::fabs(mu[i]),_bv);
+                double pressure = (k[i]/_kp)*(k[i]/_kp);
+                result[i] *= std::exp(growth*(1-pecvelocity)-pressure);
+            }
+        }
+        // Parallel pixelization smoothing
+        if(_pixPar != 0) {
+            for(int i = 0; i < n; ++i) {
+                double kpar = std::fabs(k[i]*mu[i]);
+                double pix = std::sin(_pixPar*kpar)/(_pixPar*kpar);
+                result[i] *= pix*pix;
+            }
+        }
+    }
 private:
     double _bias,_biasbeta,_biasGamma,_biasSourceAbsorber,_biasAbsorberResponse,
         _meanFreePath,_snlPar2,_snlPerp2,_kc,_kcAlt,_pc,_sigma8,_qnl,_kv,_av,_bv,_kp,
@@ -115,8 +200,8 @@ int main(int argc, char **argv) {
     
     // Configure command-line option processing
     po::options_description cli("Cosmology distorted power correlation function");
-    std::string input,delta,output;
-    int ellMax,nr,repeat,nk,nmu,samplesPerDecade,nrprt;
+    std::string input,delta,output,kernelCache;
+    int ellMax,nr,repeat,nk,nmu,samplesPerDecade,nrprt,muOrder;
     double rmin,rmax,relerr,abserr,abspow,maxRelError,kmin,kmax,margin,vepsMin,vepsMax,drprt;
     double bias,biasbeta,biasGamma,biasSourceAbsorber,biasAbsorberResponse,meanFreePath,
         snlPar,snlPerp,kc,kcAlt,pc,sigma8,qnl,kv,av,bv,kp,knl,pnl,kpp,pp,kv0,pv,kvi,pvi,pixPar;
@@ -206,9 +291,13 @@ int main(int argc, char **argv) {
             "number of samples per decade to use for transform interpolation in k")
         ("max-rel-error", po::value<double>(&maxRelError)->default_value(1e-3),
             "maximum allowed relative error for power-law extrapolation of input P(k)")
+        ("mu-order", po::value<int>(&muOrder)->default_value(16),
+            "number of Gauss-Legendre nodes in 0 < mu < 1 for projecting P(k,mu) multipoles")
         ("direct-power-multipoles",
             "use direct calculation of P(k) multipoles instead of interpolation")
         ("optimize", "optimizes transform FFTs")
+        ("kernel-cache", po::value<std::string>(&kernelCache)->default_value(""),
+            "existing directory for caching transform kernels and FFT wisdom between runs")
         ("bypass", "bypasses the termination test for transforms")
         ("repeat", po::value<int>(&repeat)->default_value(1),
             "number of times to repeat identical transform")
@@ -258,6 +347,7 @@ int main(int argc, char **argv) {
     int dell(symmetric ? 2:1);
 
     try {
+        if(kernelCache.length() > 0) cosmo::MultipoleTransform::setKernelCacheDirectory(kernelCache);
         cosmo::TabulatedPowerCPtr power =
             cosmo::createTabulatedPower(input,true,true,maxRelError,verbose);
         if(delta.length() > 0) {
@@ -273,6 +363,8 @@ int main(int argc, char **argv) {
             snlPar,snlPerp,kc,kcAlt,pc,sigma8,qnl,kv,av,bv,kp,knl,pnl,kpp,pp,kv0,pv,kvi,pvi,pixPar));
         cosmo::KMuPkFunctionCPtr distPtr(new cosmo::KMuPkFunction(boost::bind(
             &LyaDistortion::operator(),rsd,_1,_2,_3)));
+        cosmo::KMuPkBatchFunctionCPtr batchPtr(new cosmo::KMuPkBatchFunction(boost::bind(
+            &LyaDistortion::evaluate,rsd,_1,_2,_3,_4,_5)));
 
         // Use the limits of the input tabulated power for tabulating the
         // power multipoles (the kmin,kmax cmd-line args are for output only)
@@ -280,7 +372,13 @@ int main(int argc, char **argv) {
         int nkint = std::ceil(std::log10(khi/klo)*samplesPerDecade);
     	cosmo::DistortedPowerCorrelation dpc(PkPtr,distPtr,
             klo,khi,nkint,rmin,rmax,nr,ellMax,
-            symmetric,relerr,abserr,abspow);
+            symmetric,relerr,abserr,abspow,muOrder);
+        dpc.setBatchDistortion(batchPtr);
+        if(rsd->isPolynomial()) {
+            cosmo::MuSquaredPolynomialFunctionCPtr coefsPtr(new cosmo::MuSquaredPolynomialFunction(
+                boost::bind(&LyaDistortion::getCoefficients,rsd,_1,_2,_3,_4)));
+            dpc.setPolynomialDistortion(coefsPtr,2);
+        }
         // initialize
         dpc.initialize(nmu,margin,vepsMax,vepsMin,optimize);
         if(verbose) dpc.printToStream(std::cout);
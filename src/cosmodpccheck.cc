@@ -0,0 +1,220 @@
+// Created 16-Oct-2026 by agent <agent@local>
+// Checks that repeated DistortedPowerCorrelation transforms do not allocate any heap memory,
+// by counting calls to the global operator new, that combining cached basis transforms
+// reproduces a full transform, and that transformed derivatives agree with finite
+// differences of full transforms. Exits with a non-zero status if any check fails, so this
+// program can be run by 'make check'.
+
+#include "cosmo/cosmo.h"
+#include "likely/likely.h"
+#include "likely/function_impl.h"
+
+#include "boost/bind.hpp"
+#include "boost/detail/atomic_count.hpp"
+
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <algorithm>
+#include <vector>
+#include <new>
+
+// Counts heap allocations made through any form of the global operator new. The counter
+// is atomic since the library may allocate from several threads at once.
+static boost::detail::atomic_count allocationCount(0);
+
+namespace {
+    void *countedAllocation(std::size_t size) {
+        ++allocationCount;
+        return std::malloc(size ? size : 1);
+    }
+}
+
+void *operator new(std::size_t size) {
+    void *ptr = countedAllocation(size);
+    if(0 == ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](std::size_t size) {
+    void *ptr = countedAllocation(size);
+    if(0 == ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new(std::size_t size, std::nothrow_t const &) throw() {
+    return countedAllocation(size);
+}
+
+void *operator new[](std::size_t size, std::nothrow_t const &) throw() {
+    return countedAllocation(size);
+}
+
+void operator delete(void *ptr) throw() {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr) throw() {
+    std::free(ptr);
+}
+
+void operator delete(void *ptr, std::nothrow_t const &) throw() {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::nothrow_t const &) throw() {
+    std::free(ptr);
+}
+
+#ifdef __cpp_aligned_new
+// C++17 over-aligned allocations bypass the operators above, so count them too.
+namespace {
+    void *countedAlignedAllocation(std::size_t size, std::align_val_t alignment) {
+        ++allocationCount;
+        std::size_t align = static_cast<std::size_t>(alignment);
+        if(align < sizeof(void*)) align = sizeof(void*);
+        void *ptr(0);
+        if(0 != ::posix_memalign(&ptr,align,size ? size : 1)) return 0;
+        return ptr;
+    }
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+    void *ptr = countedAlignedAllocation(size,alignment);
+    if(0 == ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+    void *ptr = countedAlignedAllocation(size,alignment);
+    if(0 == ptr) throw std::bad_alloc();
+    return ptr;
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment, std::nothrow_t const &) noexcept {
+    return countedAlignedAllocation(size,alignment);
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment, std::nothrow_t const &) noexcept {
+    return countedAlignedAllocation(size,alignment);
+}
+
+void operator delete(void *ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+
+void operator delete[](void *ptr, std::align_val_t) noexcept {
+    std::free(ptr);
+}
+#endif
+
+// A smooth power spectrum P(k) with a broad peak near k = 0.02 h/Mpc.
+double power(double k) {
+    return 2e4*k/0.02*std::exp(-k/0.02)/(1+k*k);
+}
+
+// Linear redshift-space distortion (bias + f*mu^2)^2.
+double kaiser(double k, double mu, double pk, double bias, double f) {
+    double term = bias + f*mu*mu;
+    return term*term;
+}
+
+// Derivative of the Kaiser distortion with respect to f.
+double kaiserDerivative(double k, double mu, double pk, double bias, double f) {
+    return 2*mu*mu*(bias + f*mu*mu);
+}
+
+// Basis distortion scale*mu^n for expanding the Kaiser distortion in its parameters.
+double muPower(double k, double mu, double pk, int n, double scale) {
+    return scale*std::pow(mu,n);
+}
+
+// Returns the largest absolute difference between the correlation multipoles saved in
+// two workspaces, divided by the largest absolute multipole in the second.
+double compareMultipoles(cosmo::DistortedPowerCorrelation const &dpc,
+cosmo::DistortedPowerCorrelation::Workspace const &ws1,
+cosmo::DistortedPowerCorrelation::Workspace const &ws2, int ellMax) {
+    std::vector<double> const &rgrid = dpc.getRGrid();
+    double maxDiff(0), maxValue(0);
+    for(int ell = 0; ell <= ellMax; ell += 2) {
+        for(int i = 0; i < rgrid.size(); ++i) {
+            double xi1 = dpc.getCorrelationMultipole(rgrid[i],ell,ws1);
+            double xi2 = dpc.getCorrelationMultipole(rgrid[i],ell,ws2);
+            maxDiff = std::max(maxDiff,std::fabs(xi1-xi2));
+            maxValue = std::max(maxValue,std::fabs(xi2));
+        }
+    }
+    return maxValue > 0 ? maxDiff/maxValue : maxDiff;
+}
+
+int main(int argc, char **argv) {
+    int repeat(10), ellMax(4);
+    double bias(1.5), f(0.7), tolerance(1e-6);
+    bool failed(false);
+    try {
+        likely::GenericFunctionPtr powerPtr(new likely::GenericFunction(&power));
+        cosmo::KMuPkFunctionCPtr distPtr(new cosmo::KMuPkFunction(
+            boost::bind(&kaiser,_1,_2,_3,bias,f)));
+        cosmo::DistortedPowerCorrelation dpc(powerPtr,distPtr,1e-4,10.,200,10.,200.,191,ellMax);
+        // Expand the distortion as bias^2*1 + bias*f*(2*mu^2) + f^2*mu^4.
+        dpc.addBasisDistortion(cosmo::KMuPkFunctionCPtr(new cosmo::KMuPkFunction(
+            boost::bind(&muPower,_1,_2,_3,0,1.))));
+        dpc.addBasisDistortion(cosmo::KMuPkFunctionCPtr(new cosmo::KMuPkFunction(
+            boost::bind(&muPower,_1,_2,_3,2,2.))));
+        dpc.addBasisDistortion(cosmo::KMuPkFunctionCPtr(new cosmo::KMuPkFunction(
+            boost::bind(&muPower,_1,_2,_3,4,1.))));
+        dpc.initialize();
+        // The first transform may still allocate memory that is then reused.
+        dpc.transform();
+        long allocationsBefore(allocationCount);
+        for(int i = 0; i < repeat; ++i) {
+            dpc.transform();
+        }
+        long allocations(allocationCount - allocationsBefore);
+        std::cout << "Heap allocations per transform: " << allocations/(double)repeat << std::endl;
+        if(allocations > 0) failed = true;
+        // Compare the combined basis transforms with a full transform.
+        cosmo::DistortedPowerCorrelation::Workspace transformed(dpc), combined(dpc);
+        dpc.transform(transformed);
+        std::vector<double> coefficients(3);
+        coefficients[0] = bias*bias;
+        coefficients[1] = bias*f;
+        coefficients[2] = f*f;
+        dpc.combineBasis(coefficients,combined);
+        double basisError = compareMultipoles(dpc,combined,transformed,ellMax);
+        std::cout << "Basis combination relative error: " << basisError << std::endl;
+        if(!(basisError < tolerance)) failed = true;
+        // Compare the transformed derivative with respect to f with a central difference,
+        // which is exact up to roundoff since xi is quadratic in f.
+        double df(1e-3);
+        cosmo::DistortedPowerCorrelation::Workspace plus(dpc,cosmo::KMuPkFunctionCPtr(
+            new cosmo::KMuPkFunction(boost::bind(&kaiser,_1,_2,_3,bias,f+df))));
+        cosmo::DistortedPowerCorrelation::Workspace minus(dpc,cosmo::KMuPkFunctionCPtr(
+            new cosmo::KMuPkFunction(boost::bind(&kaiser,_1,_2,_3,bias,f-df))));
+        dpc.transform(plus);
+        dpc.transform(minus);
+        std::vector<cosmo::KMuPkBatchFunctionCPtr> derivatives(1,
+            cosmo::createKMuPkBatchFunction(cosmo::KMuPkFunctionCPtr(new cosmo::KMuPkFunction(
+                boost::bind(&kaiserDerivative,_1,_2,_3,bias,f)))));
+        std::vector<std::vector<double> > results;
+        dpc.transformDerivatives(derivatives,results);
+        std::vector<double> const &rgrid = dpc.getRGrid();
+        double maxDiff(0), maxValue(0);
+        for(int ell = 0; ell <= ellMax; ell += 2) {
+            for(int i = 0; i < rgrid.size(); ++i) {
+                double difference = (dpc.getCorrelationMultipole(rgrid[i],ell,plus) -
+                    dpc.getCorrelationMultipole(rgrid[i],ell,minus))/(2*df);
+                maxDiff = std::max(maxDiff,std::fabs(results[ell/2][i] - difference));
+                maxValue = std::max(maxValue,std::fabs(difference));
+            }
+        }
+        double derivativeError = maxValue > 0 ? maxDiff/maxValue : maxDiff;
+        std::cout << "Derivative relative error: " << derivativeError << std::endl;
+        if(!(derivativeError < tolerance)) failed = true;
+    }
+    catch(std::exception const &e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 2;
+    }
+    return failed ? 1 : 0;
+}
@@ -99,7 +99,7 @@ int main(int argc, char **argv) {
     // Configure command-line option processing
     po::options_description cli("Cosmology distorted power correlation function");
     std::string input,delta,output;
-    int nx,ny,nz,nr,nk,nmu,nrprt;
+    int nx,ny,nz,nr,nk,nmu,nrprt,nthreads,repeat;
     double spacing,rmin,rmax,maxRelError,kmin,kmax,drprt;
     double bias,biasbeta,biasGamma,biasSourceAbsorber,biasAbsorberResponse,meanFreePath,
         snlPar,snlPerp,kc,kcAlt,pc,sigma8,qnl,kv,av,bv,kp,knl,pnl,kpp,pp,kv0,pv,kvi,pvi;
@@ -120,6 +120,12 @@ int main(int argc, char **argv) {
             "Grid size along line-of-sight y-axis (or zero for ny=nx).")
         ("nz", po::value<int>(&nz)->default_value(0),
             "Grid size along z-axis (or zero for nz=ny).")
+        ("measure", "does initial measurements to optimize FFT plan")
+        ("symmetric", "exploit the symmetry of a distortion that is even in mu (requires even nx,ny)")
+        ("threads", po::value<int>(&nthreads)->default_value(1),
+            "number of threads to use (or zero to use all available cores)")
+        ("repeat", po::value<int>(&repeat)->default_value(1),
+            "number of times to repeat identical transform")
         ("bias", po::value<double>(&bias)->default_value(-0.14),
             "linear tracer bias")
         ("biasbeta", po::value<double>(&biasbeta)->default_value(-0.196),
@@ -206,7 +212,8 @@ int main(int argc, char **argv) {
         std::cout << cli << std::endl;
         return 1;
     }
-    bool verbose(vm.count("verbose")),thetaAngle(vm.count("theta-angle"));
+    bool verbose(vm.count("verbose")),thetaAngle(vm.count("theta-angle")),measure(vm.count("measure")),
+        symmetric(vm.count("symmetric"));
 
     if(input.length() == 0) {
         std::cerr << "Missing input filename." << std::endl;
@@ -234,13 +241,19 @@ int main(int argc, char **argv) {
         cosmo::KMuPkFunctionCPtr distPtr(new cosmo::KMuPkFunction(boost::bind(
             &LyaDistortion::operator(),rsd,_1,_2,_3)));
 
-    	cosmo::DistortedPowerCorrelationFft dpc(PkPtr,distPtr,spacing,nx,ny,nz);
+        cosmo::MultipoleTransform::Strategy strategy(measure ?
+            cosmo::MultipoleTransform::MeasurePlan :
+            cosmo::MultipoleTransform::EstimatePlan);
+    	cosmo::DistortedPowerCorrelationFft dpc(PkPtr,distPtr,spacing,nx,ny,nz,strategy,nthreads,
+            symmetric);
     	if(verbose) {
         	std::cout << "Memory size = "
             	<< boost::format("%.1f Mb") % (dpc.getMemorySize()/1048576.) << std::endl;
     	}
-    	// Transform
-    	dpc.transform();
+    	// Transform (with repeats, if requested)
+        for(int i = 0; i < repeat; ++i) {
+    	    dpc.transform();
+        }
         if(output.length() > 0) {
             double mu;
             double dmu = 1./(nmu-1.);
@@ -99,7 +99,7 @@ int main(int argc, char **argv) {
     // Configure command-line option processing
     po::options_description cli("Cosmology distorted power correlation function");
     std::string input,delta,output;
-    int nx,ny,gridscaling,nr,nk,nmu,nrprt,nkx,nry;
+    int nx,ny,gridscaling,nr,nk,nmu,nrprt,nkx,nry,nthreads,repeat;
     double kxmax,spacing,epsAbs,epsRel,rmin,rmax,maxRelError,kmin,kmax,drprt;
     double bias,biasbeta,biasGamma,biasSourceAbsorber,biasAbsorberResponse,meanFreePath,
         snlPar,snlPerp,kc,kcAlt,pc,sigma8,qnl,kv,av,bv,kp,knl,pnl,kpp,pp,kv0,pv,kvi,pvi;
@@ -123,9 +123,9 @@ int main(int argc, char **argv) {
         ("gridscaling", po::value<int>(&gridscaling)->default_value(4),
             "Scaling factor from grid spacing to interpolation grid.")
         ("epsAbs", po::value<double>(&epsAbs)->default_value(1e-8),
-            "Absolute error target for 1D integral")
+            "Absolute error target for the adaptive 1D integrals used to check the quadrature (with --verbose)")
         ("epsRel", po::value<double>(&epsRel)->default_value(1e-5),
-            "Relative error target for 1D integral")
+            "Relative error target for the adaptive 1D integrals used to check the quadrature (with --verbose)")
         ("bias", po::value<double>(&bias)->default_value(-0.14),
             "linear tracer bias")
         ("biasbeta", po::value<double>(&biasbeta)->default_value(-0.196),
@@ -201,6 +201,10 @@ int main(int argc, char **argv) {
             "number of linear-spaced k values along x-axis for saving results")
         ("nry", po::value<int>(&nry)->default_value(0),
             "number of linear-spaced r values along line-of-sight y-axis for saving results")
+        ("threads", po::value<int>(&nthreads)->default_value(1),
+            "number of threads to use (or zero to use all available cores)")
+        ("repeat", po::value<int>(&repeat)->default_value(1),
+            "number of times to repeat identical transform")
         ;
     // Do the command line parsing now
     po::variables_map vm;
@@ -243,13 +247,20 @@ int main(int argc, char **argv) {
             &LyaDistortion::operator(),rsd,_1,_2,_3)));
 
         double kxmin = power->getKMin();
-    	cosmo::DistortedPowerCorrelationHybrid dpc(PkPtr,distPtr,kxmin,kxmax,nx,spacing,ny,gridscaling,rgridmax,epsAbs,epsRel);
+    	cosmo::DistortedPowerCorrelationHybrid dpc(PkPtr,distPtr,kxmin,kxmax,nx,spacing,ny,gridscaling,rgridmax,epsAbs,epsRel,
+            nthreads);
     	if(verbose) {
         	std::cout << "Memory size = "
             	<< boost::format("%.1f Mb") % (dpc.getMemorySize()/1048576.) << std::endl;
     	}
-    	// Transform
-    	dpc.transform();
+    	// Transform (with repeats, if requested)
+        for(int i = 0; i < repeat; ++i) {
+    	    dpc.transform();
+        }
+        if(verbose) {
+            std::cout << "Quadrature relative error = " << dpc.getQuadratureError()
+                << " (compared with adaptive integration)" << std::endl;
+        }
         if(output.length() > 0) {
             double mu;
             double dmu = 1./(nmu-1.);
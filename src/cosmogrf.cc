@@ -16,6 +16,7 @@
 #include <iostream>
 #include <fstream>
 #include <string>
+#include <vector>
 
 namespace po = boost::program_options;
 namespace lk = likely;
@@ -61,6 +62,7 @@ int main(int argc, char **argv) {
             "Number of k bins to use for power spectrum measurement.")
         ("output", po::value<std::string>(&outfile)->default_value(""),
             "Filename to write delta field to.")
+        ("binary", "Writes the delta field as a binary catalog.")
         ;
 
     // do the command line parsing now
@@ -85,7 +87,7 @@ int main(int argc, char **argv) {
         std::cerr << "nkbins must be > 0" << std::endl;
         return -3;
     }
-    bool verbose(vm.count("verbose"));
+    bool verbose(vm.count("verbose")), binary(vm.count("binary"));
 
     // Fill in any missing grid dimensions.
     if(0 == ny) ny = nx;
@@ -180,20 +182,50 @@ int main(int argc, char **argv) {
     // Write delta field to file
     if (outfile.length() > 0) {
         try {
-            std::ofstream out(outfile.c_str());
-            double wgt = 1;
-            for(int ix = 0; ix < nx; ++ix) {
-                double x = (ix+0.5)*spacing;
-                for(int iy = 0; iy < ny; ++iy) {
-                    double y = (iy+0.5)*spacing;
-                    for(int iz = 0; iz < nz; ++iz) {
-                        double z = (iz+0.5)*spacing;
-                        out << x << ' ' << y << ' ' << z << ' ' 
-                            << generator.getField(ix,iy,iz) << ' ' << wgt << std::endl;
+            if(binary) {
+                std::vector<std::string> names;
+                names.push_back("x");
+                names.push_back("y");
+                names.push_back("z");
+                names.push_back("delta");
+                names.push_back("weight");
+                cosmo::BinaryCatalogWriter writer(outfile,names,(long)nx*ny*nz);
+                double *xcol(writer.getFloat64Column(0)), *ycol(writer.getFloat64Column(1)),
+                    *zcol(writer.getFloat64Column(2)), *delta(writer.getFloat64Column(3)),
+                    *wcol(writer.getFloat64Column(4));
+                long row(0);
+                for(int ix = 0; ix < nx; ++ix) {
+                    double x = (ix+0.5)*spacing;
+                    for(int iy = 0; iy < ny; ++iy) {
+                        double y = (iy+0.5)*spacing;
+                        for(int iz = 0; iz < nz; ++iz) {
+                            xcol[row] = x;
+                            ycol[row] = y;
+                            zcol[row] = (iz+0.5)*spacing;
+                            delta[row] = generator.getField(ix,iy,iz);
+                            wcol[row] = 1;
+                            row++;
+                        }
                     }
                 }
+                writer.close();
+            }
+            else {
+                std::ofstream out(outfile.c_str());
+                double wgt = 1;
+                for(int ix = 0; ix < nx; ++ix) {
+                    double x = (ix+0.5)*spacing;
+                    for(int iy = 0; iy < ny; ++iy) {
+                        double y = (iy+0.5)*spacing;
+                        for(int iz = 0; iz < nz; ++iz) {
+                            double z = (iz+0.5)*spacing;
+                            out << x << ' ' << y << ' ' << z << ' ' 
+                                << generator.getField(ix,iy,iz) << ' ' << wgt << std::endl;
+                        }
+                    }
+                }
+                out.close();
             }
-            out.close();
         }
         catch(std::exception const &e) {
             std::cerr << "Error while saving delta field: " << e.what() << std::endl;
@@ -10,6 +10,7 @@
 #include <iostream>
 #include <fstream>
 #include <cmath>
+#include <algorithm>
 
 namespace po = boost::program_options;
 namespace lk = likely;
@@ -23,11 +24,12 @@ int main(int argc, char **argv) {
         ("help,h", "Prints this info and exits.")
         ("verbose", "Prints additional information.")
         ("rvectors", po::value<std::string>(&rvectors)->default_value(""),
-            "Filename to read r-vectors from")
+            "Filename to read r-vectors from (text or binary catalog)")
         ("kvectors", po::value<std::string>(&kvectors)->default_value(""),
-            "Filename to read k-vectors from")
+            "Filename to read k-vectors from (text or binary catalog)")
         ("output,o", po::value<std::string>(&outfile)->default_value("mock.dat"),
             "Filename to save generated mock to")
+        ("binary", "Saves the generated mock as a binary catalog.")
         ;
 
     // do the command line parsing now
@@ -44,7 +46,7 @@ int main(int argc, char **argv) {
         std::cout << cli << std::endl;
         return 1;
     }
-    bool verbose(vm.count("verbose")),rmu(vm.count("rmu"));
+    bool verbose(vm.count("verbose")),rmu(vm.count("rmu")),binary(vm.count("binary"));
 
     // Read the r-vectors file
     if(0 == rvectors.length()) {
@@ -53,9 +55,7 @@ int main(int argc, char **argv) {
     }
     std::vector<std::vector<double> > rvec(3);
     try {
-        std::ifstream in(rvectors.c_str());
-        lk::readVectors(in,rvec);
-        in.close();
+        cosmo::readCatalog(rvectors,rvec);
     }
     catch(std::exception const &e) {
         std::cerr << "Error while reading " << rvectors << ": " << e.what() << std::endl;
@@ -74,9 +74,7 @@ int main(int argc, char **argv) {
     }
     std::vector<std::vector<double> > kvec(5);
     try {
-        std::ifstream in(kvectors.c_str());
-        lk::readVectors(in,kvec);
-        in.close();
+        cosmo::readCatalog(kvectors,kvec);
     }
     catch(std::exception const &e) {
         std::cerr << "Error while reading " << kvectors << ": " << e.what() << std::endl;
@@ -88,7 +86,32 @@ int main(int argc, char **argv) {
             << std::endl;
     }
 
-    std::ofstream out(outfile.c_str());
+    std::ofstream out;
+    boost::scoped_ptr<cosmo::BinaryCatalogWriter> writer;
+    double *deltaColumn(0);
+    try {
+        if(binary) {
+            std::vector<std::string> names;
+            names.push_back("x");
+            names.push_back("y");
+            names.push_back("z");
+            names.push_back("delta");
+            names.push_back("weight");
+            writer.reset(new cosmo::BinaryCatalogWriter(outfile,names,npixels));
+            for(int k = 0; k < 3; ++k) {
+                if(npixels > 0) writer->setColumn(k,&rvec[k][0],0,npixels);
+            }
+            std::fill(writer->getFloat64Column(4),writer->getFloat64Column(4)+npixels,1.);
+            deltaColumn = writer->getFloat64Column(3);
+        }
+        else {
+            out.open(outfile.c_str());
+        }
+    }
+    catch(std::exception const &e) {
+        std::cerr << "Error while creating " << outfile << ": " << e.what() << std::endl;
+        return -4;
+    }
 
     // Evaluate realization (kvec) at each survey pixel (rvec)
     double wgt = 1;
@@ -100,10 +123,20 @@ int main(int argc, char **argv) {
             delta += kvec[3][j]*std::cos(dot+kvec[4][j]);
         }
         delta *= 2;
-        out << rvec[0][i] << ' ' << rvec[1][i] << ' ' << rvec[2][i] << ' ' << delta << ' ' << wgt << std::endl;
+        if(binary) {
+            deltaColumn[i] = delta;
+        }
+        else {
+            out << rvec[0][i] << ' ' << rvec[1][i] << ' ' << rvec[2][i] << ' ' << delta << ' ' << wgt << std::endl;
+        }
     }
 
-    out.close();
+    if(binary) {
+        writer->close();
+    }
+    else {
+        out.close();
+    }
 
     return 0;
 }
@@ -12,6 +12,8 @@
 
 #include <iostream>
 #include <fstream>
+#include <cmath>
+#include <algorithm>
 
 namespace po = boost::program_options;
 namespace lk = likely;
@@ -20,7 +22,7 @@ int main(int argc, char **argv) {
     
     // Configure command-line option processing
     po::options_description cli("Cosmology multipole transforms");
-    std::string input,output;
+    std::string input,output,precisionName;
     int ell,minSamplesPerCycle,minSamplesPerDecade;
     double min,max,veps,maxRelError;
     cli.add_options()
@@ -40,6 +42,9 @@ int main(int argc, char **argv) {
         ("veps", po::value<double>(&veps)->default_value(1e-3),
             "desired transform accuracy")
         ("measure", "does initial measurements to optimize FFT plan")
+        ("precision", po::value<std::string>(&precisionName)->default_value("double"),
+            "precision of internal FFT convolution (single,double,extended)")
+        ("accuracy-report", "compares the results of each available precision with double")
         ("min-samples-per-cycle", po::value<int>(&minSamplesPerCycle)->default_value(2),
             "minimum number of samples per cycle to use for transform convolution")
         ("min-samples-per-decade", po::value<int>(&minSamplesPerDecade)->default_value(40),
@@ -62,7 +67,7 @@ int main(int argc, char **argv) {
         return 1;
     }
     bool verbose(vm.count("verbose")),hankel(vm.count("hankel")),
-        measure(vm.count("measure"));
+        measure(vm.count("measure")),accuracyReport(vm.count("accuracy-report"));
 
     if(input.length() == 0) {
         std::cerr << "Missing input filename." << std::endl;
@@ -81,9 +86,24 @@ int main(int argc, char **argv) {
         cosmo::MultipoleTransform::MeasurePlan :
         cosmo::MultipoleTransform::EstimatePlan);
 
+    cosmo::MultipoleTransform::Precision precision;
+    if(precisionName == "single") {
+        precision = cosmo::MultipoleTransform::SinglePrecision;
+    }
+    else if(precisionName == "double") {
+        precision = cosmo::MultipoleTransform::DoublePrecision;
+    }
+    else if(precisionName == "extended") {
+        precision = cosmo::MultipoleTransform::ExtendedPrecision;
+    }
+    else {
+        std::cerr << "Invalid precision: " << precisionName << std::endl;
+        return -1;
+    }
+
     try {
     	cosmo::MultipoleTransform mt(ttype,ell,min,max,veps,strategy,
-            minSamplesPerCycle,minSamplesPerDecade);
+            minSamplesPerCycle,minSamplesPerDecade,3,precision);
         std::vector<double> const& ugrid = mt.getUGrid(), vgrid = mt.getVGrid();
         if(verbose) {
             std::cout << "Truncation fraction is " << mt.getTruncationFraction() << std::endl;
@@ -100,6 +120,40 @@ int main(int argc, char **argv) {
         }
         std::vector<double> results(vgrid.size());
         mt.transform(funcData,results);
+        if(accuracyReport) {
+            // Repeat the transform with each precision and compare with double precision
+            // over [min,max], using the same grids.
+            cosmo::MultipoleTransform mtDouble(ttype,ell,min,max,veps,strategy,
+                minSamplesPerCycle,minSamplesPerDecade,3,cosmo::MultipoleTransform::DoublePrecision);
+            std::vector<double> reference;
+            mtDouble.transform(funcData,reference);
+            double refMax(0);
+            for(int i = 0; i < vgrid.size(); ++i) {
+                if(vgrid[i] < min || vgrid[i] > max) continue;
+                refMax = std::max(refMax,std::fabs(reference[i]));
+            }
+            char const *names[3] = { "single", "double", "extended" };
+            for(int p = 0; p < 3; ++p) {
+                std::vector<double> other;
+                try {
+                    cosmo::MultipoleTransform mtOther(ttype,ell,min,max,veps,strategy,
+                        minSamplesPerCycle,minSamplesPerDecade,3,
+                        (cosmo::MultipoleTransform::Precision)p);
+                    mtOther.transform(funcData,other);
+                }
+                catch(cosmo::RuntimeError const &e) {
+                    std::cout << names[p] << " precision is not available." << std::endl;
+                    continue;
+                }
+                double maxAbs(0);
+                for(int i = 0; i < vgrid.size(); ++i) {
+                    if(vgrid[i] < min || vgrid[i] > max) continue;
+                    maxAbs = std::max(maxAbs,std::fabs(other[i] - reference[i]));
+                }
+                std::cout << names[p] << " precision: max |diff| = " << maxAbs
+                    << ", max |diff|/max|xi| = " << (refMax > 0 ? maxAbs/refMax : 0) << std::endl;
+            }
+        }
         if(output.length() > 0) {
             std::ofstream out(output.c_str());
             for(int i = 0; i < results.size(); ++i) {
@@ -15,68 +15,17 @@
 namespace po = boost::program_options;
 namespace lk = likely;
 
-// Brute force timing for 2M pairs in DR9-like volume:
-// used -603397146 of -1455759936 pairs.
-// 29805.930u 18.906s 8:17:02.56 100.0%    0+0k 0+4io 0pf+0w
-void bruteForce(std::vector<std::vector<double> > const &columns, lk::BinnedGrid const &grid, bool rmu,
-double x1min, double x1max, double x2min, double x2max, std::vector<double> &xi) {
-    // create internal accumulation vectors
-    int nbins = grid.getNBinsTotal();
-    std::vector<double> dsum(nbins,0.), wsum(nbins,0.);
-    // Do a brute force loop over all pairs
-    int n(columns[0].size());
-    long npair(0), nused(0);
-    std::vector<double> separation(2);
-    for(int i = 0; i < n-1; ++i) {
-        double xi = columns[0][i];
-        double yi = columns[1][i];
-        double zi = columns[2][i];
-        double di = columns[3][i];
-        double wi = columns[4][i];
-        for(int j = i+1; j < n; ++j) {
-            double dx = xi - columns[0][j];
-            double dy = yi - columns[1][j];
-            double dz = zi - columns[2][j];
-            if(rmu) {
-                separation[0] = std::sqrt(dx*dx+dy*dy+dz*dz);
-                separation[1] = std::fabs(dz/separation[0]);
-            }
-            else {
-                separation[0] = std::fabs(dz);
-                separation[1] = std::sqrt(dx*dx+dy*dy);
-            }
-            npair++;
-            if(separation[0] < x1min || separation[0] >= x1max) continue;
-            if(separation[1] < x2min || separation[1] >= x2max) continue;
-            try {
-                int index = grid.getIndex(separation);
-                double wgt = wi*columns[4][j];
-                dsum[index] += wgt*di*columns[3][j];
-                wsum[index] += wgt;
-                nused++;
-            }
-            catch(lk::RuntimeError const &e) {
-                std::cerr << "no bin found for i,j = " << i << ',' << j << std::endl;
-            }
-        }
-    }
-    std::cout << "used " << nused << " of " << npair << " pairs." << std::endl;
-    for(int index = 0; index < nbins; ++index) {
-        if(wsum[index] > 0) dsum[index] /= wsum[index];
-    }
-    dsum.swap(xi);
-}
-
 int main(int argc, char **argv) {
     
     // Configure command-line option processing
     std::string infile,outfile,axis1,axis2;
+    int nthreads;
     po::options_description cli("Correlation function estimator");
     cli.add_options()
         ("help,h", "Prints this info and exits.")
         ("verbose", "Prints additional information.")
         ("input,i", po::value<std::string>(&infile)->default_value(""),
-            "Filename to read field samples from")
+            "Filename to read field samples from (text or binary catalog)")
         ("output,o", po::value<std::string>(&outfile)->default_value("xi.dat"),
             "Filename to write correlation function to")
         ("axis1", po::value<std::string>(&axis1)->default_value("[0:200]*50"),
@@ -84,6 +33,8 @@ int main(int argc, char **argv) {
         ("axis2", po::value<std::string>(&axis2)->default_value("[0:200]*50"),
             "Axis-2 binning")
         ("rmu", "Use (r,mu) binning instead of (rP,rT) binning")
+        ("threads", po::value<int>(&nthreads)->default_value(0),
+            "Number of threads to use for pair counting (or zero to use all available cores)")
         ;
 
     // do the command line parsing now
@@ -109,9 +60,7 @@ int main(int argc, char **argv) {
     }
     std::vector<std::vector<double> > columns(5);
     try {
-        std::ifstream in(infile.c_str());
-        lk::readVectors(in,columns);
-        in.close();
+        cosmo::readCatalog(infile,columns);
     }
     catch(std::exception const &e) {
         std::cerr << "Error while reading " << infile << ": " << e.what() << std::endl;
@@ -126,10 +75,20 @@ int main(int argc, char **argv) {
     std::vector<double> xi;
     try {
         lk::AbsBinningCPtr bins1 = lk::createBinning(axis1), bins2 = lk::createBinning(axis2);
-        double x1min(bins1->getBinLowEdge(0)), x1max(bins1->getBinHighEdge(bins1->getNBins()-1));
-        double x2min(bins2->getBinLowEdge(0)), x2max(bins2->getBinHighEdge(bins2->getNBins()-1));
         lk::BinnedGrid grid(bins1,bins2);
-        bruteForce(columns,grid,rmu,x1min,x1max,x2min,x2max,xi);
+        cosmo::PairCounter counter(columns[0],columns[1],columns[2],grid,
+            rmu ? cosmo::PairCounter::RadiusMu : cosmo::PairCounter::ParallelPerpendicular);
+        if(verbose) {
+            std::cout << "Using " << counter.getNumCellsX() << " x " << counter.getNumCellsY()
+                << " x " << counter.getNumCellsZ() << " chaining mesh cells." << std::endl;
+        }
+        std::vector<double> wsum;
+        counter.accumulate(columns[3],columns[4],xi,wsum,nthreads);
+        std::cout << "used " << counter.getNumPairsUsed() << " of "
+            << counter.getNumPairsTested() << " pairs." << std::endl;
+        for(int index = 0; index < xi.size(); ++index) {
+            if(wsum[index] > 0) xi[index] /= wsum[index];
+        }
     }
     catch(std::exception const &e) {
         std::cerr << "Error while running the estimator: " << e.what() << std::endl;